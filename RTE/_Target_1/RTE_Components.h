@@ -16,6 +16,9 @@
  */
 #define CMSIS_device_header "LPC17xx.h"
 
+/*  Keil.ARM Compiler::Compiler:Event Recorder:DAP:1.4.0 */
+#define RTE_Compiler_EventRecorder
+          #define RTE_Compiler_EventRecorder_DAP
 /*  ARM::CMSIS:RTOS2:Keil RTX5:Library:5.5.1 */
 #define RTE_CMSIS_RTOS2                 /* CMSIS-RTOS2 */
         #define RTE_CMSIS_RTOS2_RTX5            /* CMSIS-RTOS2 Keil RTX5 */
@@ -0,0 +1,111 @@
+#include "barrier.h"
+
+#include <string.h>
+
+#define COUNT_BITS 8
+#define COUNT_MASK ((1u << COUNT_BITS) - 1)
+#define GENERATION_FLAGS 8
+
+#define GENERATION_MASK (0xFFFFFFFFu >> COUNT_BITS)
+
+// How far the barrier is past the caller's generation, modulo the 24 bits
+// kept in the state word. Anything in the upper half means the caller is
+// ahead, which only happens when the barrier was re-initialised under it
+static uint32_t behind(uint32_t state, uint32_t generation){
+	return ((state >> COUNT_BITS) - generation) & GENERATION_MASK;
+}
+
+
+// Each generation wakes on its own flag so a slow waiter of the previous
+// generation never sees a flag that was meant for the next one
+static uint32_t generationFlag(uint32_t generation){
+	return 1u << (generation % GENERATION_FLAGS);
+}
+
+
+// Moves the barrier from generation to generation+1 and wakes its waiters.
+// Only the caller whose compare-and-swap succeeds does the wake-up. The flag
+// of generation+1 still holds the bit of generation-7, so it is cleared
+// before anyone can arrive there. A caller that loses the swap may clear a
+// flag the winner already set, which only sends those waiters through the
+// timeout path, and that finds the generation released
+static bool release(barrier_t *barrier, uint32_t state, uint32_t generation){
+	osEventFlagsClear(barrier->flags, generationFlag(generation+1));
+	if (!__sync_bool_compare_and_swap(&barrier->state, state, ((generation+1) & GENERATION_MASK) << COUNT_BITS))
+		return false;
+	barrier->releasedAt = osKernelGetSysTimerCount();
+	osEventFlagsSet(barrier->flags, generationFlag(generation));
+	return true;
+}
+
+
+static void recordLatency(barrier_t *barrier){
+	uint32_t latency = osKernelGetSysTimerCount() - barrier->releasedAt;
+	uint32_t max = barrier->stats.maxLatency;
+	__sync_fetch_and_add(&barrier->stats.wakeups, 1);
+	__sync_fetch_and_add(&barrier->stats.totalLatency, latency);
+	while (latency > max && !__sync_bool_compare_and_swap(&barrier->stats.maxLatency, max, latency))
+		max = barrier->stats.maxLatency;
+}
+
+
+/**
+ * Creates a barrier for the given number of parties, starting at generation 0
+  */
+bool barrierInit(barrier_t *barrier, uint8_t parties){
+	memset(barrier, 0, sizeof(barrier_t));
+	barrier->parties = parties;
+	barrier->flags = osEventFlagsNew(NULL);
+	return barrier->flags != NULL;
+}
+
+
+void barrierDelete(barrier_t *barrier){
+	osEventFlagsDelete(barrier->flags);
+	barrier->flags = NULL;
+}
+
+
+/**
+ * Waits until every party reached the generation in *generation, which is
+ * the caller's own count of barriers passed and is advanced on return.
+ * A party that times out abandons the generation so the others are not held
+ * hostage. A party arriving for a generation that was already released or
+ * abandoned returns at once with osErrorTimeout, and osErrorResource means
+ * the barrier was deleted or re-initialised under the caller.
+  */
+osStatus_t barrierWait(barrier_t *barrier, uint32_t *generation, uint32_t timeout){
+	uint32_t mine = (*generation)++;
+	uint32_t state;
+
+	// Arrive, unless the barrier already moved past our generation
+	do {
+		state = barrier->state;
+		if (behind(state, mine) > GENERATION_MASK/2)
+			return osErrorResource;
+		if (behind(state, mine) != 0)
+			return osErrorTimeout;
+	} while (!__sync_bool_compare_and_swap(&barrier->state, state, state+1));
+
+	if ((state & COUNT_MASK) + 1 == barrier->parties){
+		release(barrier, state+1, mine);
+		return osOK;
+	}
+
+	uint32_t flags = osEventFlagsWait(barrier->flags, generationFlag(mine), osFlagsWaitAny | osFlagsNoClear, timeout);
+	if (!(flags & osFlagsError)){
+		recordLatency(barrier);
+		return osOK;
+	}
+	if (flags != osFlagsErrorTimeout && timeout != 0)
+		return osErrorResource;
+
+	// Timed out: abandon the generation unless someone released it meanwhile
+	do {
+		state = barrier->state;
+		if (behind(state, mine) != 0)
+			return osOK;
+	} while (!release(barrier, state, mine));
+	__sync_fetch_and_add(&barrier->stats.timeouts, 1);
+	return osErrorTimeout;
+}
@@ -0,0 +1,30 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <cmsis_os2.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wake-up-to-run latency of released waiters, in kernel system timer counts
+typedef struct {
+	uint32_t wakeups;
+	uint32_t timeouts;
+	uint32_t totalLatency;
+	uint32_t maxLatency;
+} barrier_stats_t;
+
+// Reusable barrier: the state word holds the generation in the upper 24 bits
+// and the number of parties that arrived in the lower 8, so both move together
+typedef struct {
+	osEventFlagsId_t flags;
+	uint8_t parties;
+	volatile uint32_t state;
+	volatile uint32_t releasedAt;
+	barrier_stats_t stats;
+} barrier_t;
+
+bool barrierInit(barrier_t *barrier, uint8_t parties);
+void barrierDelete(barrier_t *barrier);
+osStatus_t barrierWait(barrier_t *barrier, uint32_t *generation, uint32_t timeout);
+
+#endif
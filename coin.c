@@ -0,0 +1,30 @@
+#include "coin.h"
+#include "general.h"
+
+#define COIN_INSTANCES 64
+
+// Common coin of the randomized engine: one word per instance, bit r is the
+// coin of round r. The words are drawn once from the seed, so every general
+// reads the same coin without a message and a run can be replayed
+uint32_t coinTable[COIN_INSTANCES];
+
+
+/**
+ * Fills the coin table from a seed, 0 is taken as 1
+  */
+void coinSeed(uint32_t seed){
+	uint32_t x = seed ? seed : 1;
+	for (int i = 0; i < COIN_INSTANCES; i++){
+		// xorshift32
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		coinTable[i] = x;
+	}
+}
+
+
+// Coin of a round of an instance as a value, the same for every general
+char coinFlip(uint32_t instance, uint8_t round){
+	return (coinTable[instance % COIN_INSTANCES] >> (round % COIN_ROUNDS)) & 1 ? ATTACK : RETREAT;
+}
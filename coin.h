@@ -0,0 +1,12 @@
+#ifndef COIN_H
+#define COIN_H
+
+#include <stdint.h>
+
+// Rounds of one instance that get a coin of their own
+#define COIN_ROUNDS 32
+
+void coinSeed(uint32_t seed);
+char coinFlip(uint32_t instance, uint8_t round);
+
+#endif
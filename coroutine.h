@@ -0,0 +1,17 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdint.h>
+
+// Stackless coroutines in the protothread style. The body of a step function
+// sits between CO_BEGIN and CO_END, and CO_YIELD returns false to the caller
+// and resumes right after itself on the next call. Locals do not survive a
+// yield, so anything needed across one lives in the caller's state struct.
+// A switch cannot be used across a yield in the same function
+typedef uint16_t co_resume_t;
+
+#define CO_BEGIN(resume) switch (resume) { case 0:
+#define CO_YIELD(resume) do { (resume) = __LINE__; return false; case __LINE__:; } while (0)
+#define CO_END(resume) } (resume) = 0; return true
+
+#endif
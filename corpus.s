@@ -0,0 +1,15 @@
+; Links the scenario corpus into flash as it is, for the batch runner in
+; final.c. Regenerate scenarios.bin with util/scenarios.py
+
+                AREA    ScenarioCorpus, DATA, READONLY, ALIGN=2
+                EXPORT  scenarioCorpus
+                EXPORT  scenarioCorpusSize
+
+scenarioCorpus
+                INCBIN  scenarios.bin
+scenarioCorpusEnd
+                ALIGN   4
+scenarioCorpusSize
+                DCD     scenarioCorpusEnd - scenarioCorpus
+
+                END
@@ -0,0 +1,96 @@
+#include "counters.h"
+
+#include "fmt.h"
+#include <string.h>
+
+// Every sent and received counter has a single writer, the thread running
+// that general. Inbox depth and overflows are updated by any sender
+counters_t counters;
+
+
+void countersReset(void){
+	memset(&counters, 0, sizeof(counters_t));
+}
+
+
+void countSend(uint8_t round, uint8_t sender, uint32_t bytes){
+	counters.sent[round][sender]++;
+	counters.bytesSent[round][sender] += bytes;
+}
+
+
+void countReceive(uint8_t round, uint8_t receiver, uint32_t bytes){
+	counters.received[round][receiver]++;
+	counters.bytesReceived[round][receiver] += bytes;
+}
+
+
+void countDepth(uint8_t round, uint8_t receiver, uint32_t depth){
+	uint32_t max = counters.highWater[round][receiver];
+	while (depth > max && !__sync_bool_compare_and_swap(&counters.highWater[round][receiver], max, depth))
+		max = counters.highWater[round][receiver];
+}
+
+
+void countBlockedPut(uint8_t id, uint32_t cycles){
+	counters.blockedPut[id] += cycles;
+}
+
+
+void countBlockedGet(uint8_t id, uint32_t cycles){
+	counters.blockedGet[id] += cycles;
+}
+
+
+void countOverflow(uint8_t receiver){
+	__sync_fetch_and_add(&counters.overflows[receiver], 1);
+}
+
+
+/**
+ * Copies the counters out, meant for after broadcast() returned and the
+ * generals are idle again
+  */
+void countersSnapshot(counters_t *snapshot){
+	memcpy(snapshot, &counters, sizeof(counters_t));
+}
+
+
+/**
+ * Messages OM(m) sends in a round when nobody is silent or floods: each of
+ * the n-1 lieutenants gets one per EIG node of that level, P(n-2, round)
+  */
+uint32_t omMessages(uint8_t n, uint8_t round){
+	uint32_t messages = n-1;
+	for (uint8_t k = 0; k < round; k++)
+		messages *= n-2-k;
+	return messages;
+}
+
+
+/**
+ * Prints the traffic of each round, against what OM(m) should have sent when
+ * om says the engine sends per path, then what every general waited for
+  */
+void reportCounters(const counters_t *snapshot, uint8_t n, uint8_t m, bool om){
+	for (uint8_t round = 0; round <= m; round++){
+		uint32_t sent = 0, received = 0, bytes = 0, highWater = 0;
+		for (uint8_t id = 0; id < n; id++){
+			sent += snapshot->sent[round][id];
+			received += snapshot->received[round][id];
+			bytes += snapshot->bytesSent[round][id];
+			if (snapshot->highWater[round][id] > highWater)
+				highWater = snapshot->highWater[round][id];
+		}
+		if (om)
+			fmtPrintf("round: %u, sent: %u, received: %u, expected: %u, bytes: %u, high water: %u\n",
+				round, sent, received, omMessages(n, round), bytes, highWater);
+		else
+			fmtPrintf("round: %u, sent: %u, received: %u, bytes: %u, high water: %u\n",
+				round, sent, received, bytes, highWater);
+	}
+	for (uint8_t id = 0; id < n; id++){
+		fmtPrintf("id: %u, blocked put: %u, get: %u cycles, overflows: %u\n",
+			id, snapshot->blockedPut[id], snapshot->blockedGet[id], snapshot->overflows[id]);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COUNTER_GENERALS 7
+#define COUNTER_ROUNDS 3
+
+// Traffic of one OM instance. Messages and bytes are per (round, general),
+// bytes being the message text a handle points to. highWater is the deepest
+// each inbox got, blocked times are in kernel system timer counts
+typedef struct {
+	uint32_t sent[COUNTER_ROUNDS][COUNTER_GENERALS];
+	uint32_t received[COUNTER_ROUNDS][COUNTER_GENERALS];
+	uint32_t bytesSent[COUNTER_ROUNDS][COUNTER_GENERALS];
+	uint32_t bytesReceived[COUNTER_ROUNDS][COUNTER_GENERALS];
+	uint32_t highWater[COUNTER_ROUNDS][COUNTER_GENERALS];
+	uint32_t blockedPut[COUNTER_GENERALS];
+	uint32_t blockedGet[COUNTER_GENERALS];
+	uint32_t overflows[COUNTER_GENERALS];
+} counters_t;
+
+void countersReset(void);
+void countSend(uint8_t round, uint8_t sender, uint32_t bytes);
+void countReceive(uint8_t round, uint8_t receiver, uint32_t bytes);
+void countDepth(uint8_t round, uint8_t receiver, uint32_t depth);
+void countBlockedPut(uint8_t id, uint32_t cycles);
+void countBlockedGet(uint8_t id, uint32_t cycles);
+void countOverflow(uint8_t receiver);
+void countersSnapshot(counters_t *snapshot);
+uint32_t omMessages(uint8_t n, uint8_t round);
+void reportCounters(const counters_t *snapshot, uint8_t n, uint8_t m, bool om);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef EVR_OM_H
+#define EVR_OM_H
+
+#include <stdint.h>
+#include "RTE_Components.h"
+
+// Event Recorder annotations of an OM instance, decoded by om.scvd. They are
+// compiled in when the Compiler:Event Recorder component is selected in the
+// run-time environment, and are empty otherwise
+#define EVR_OM_NO 0x0A
+
+#define EVR_OM_INSTANCE_START 0x00
+#define EVR_OM_ROUND_ENTER 0x01
+#define EVR_OM_ROUND_EXIT 0x02
+#define EVR_OM_RELAY_PUT 0x03
+#define EVR_OM_RELAY_GET 0x04
+#define EVR_OM_RESOLVE 0x05
+#define EVR_OM_DECISION 0x06
+
+#ifdef RTE_Compiler_EventRecorder
+#include "EventRecorder.h"
+
+#define EvrOm(msg, val1, val2) \
+	EventRecord2(EventID(EventLevelOp, EVR_OM_NO, msg), (val1), (val2))
+
+// Digits of "s:...:c:V" as hex nibbles in the order they are written, so
+// 0x564 is the message 5:6:4:V
+static inline uint32_t evrPath(const char *msg){
+	uint32_t path = 0;
+	while (msg[0] >= '0' && msg[0] <= '9' && msg[1] == ':'){
+		path = (path << 4) | (msg[0] - '0');
+		msg += 2;
+	}
+	return path;
+}
+
+// Value of "s:...:c:V"
+static inline uint32_t evrValue(const char *msg){
+	while (msg[0] >= '0' && msg[0] <= '9' && msg[1] == ':')
+		msg += 2;
+	return (uint8_t)msg[0];
+}
+
+#define EvrOmInstanceStart(commander, n, m) \
+	EvrOm(EVR_OM_INSTANCE_START, (commander) | ((n) << 8), (m))
+#define EvrOmRoundEnter(id, round) \
+	EvrOm(EVR_OM_ROUND_ENTER, (id), (round))
+#define EvrOmRoundExit(id, round, received) \
+	EvrOm(EVR_OM_ROUND_EXIT, (id), (round) | ((received) << 8))
+#define EvrOmRelayPut(id, receiver, round, msg) \
+	EvrOm(EVR_OM_RELAY_PUT, (id) | ((receiver) << 8) | ((round) << 16) | (evrValue(msg) << 24), evrPath(msg))
+#define EvrOmRelayGet(id, round, msg) \
+	EvrOm(EVR_OM_RELAY_GET, (id) | ((round) << 16) | (evrValue(msg) << 24), evrPath(msg))
+#define EvrOmResolve(id, level, nodes) \
+	EvrOm(EVR_OM_RESOLVE, (id), (level) | ((nodes) << 8))
+#define EvrOmDecision(id, decision) \
+	EvrOm(EVR_OM_DECISION, (id), (decision))
+
+#else
+
+// Arguments are still evaluated so values only traced do not go unused
+#define EvrOmInstanceStart(commander, n, m) ((void)(commander), (void)(n), (void)(m))
+#define EvrOmRoundEnter(id, round) ((void)(id), (void)(round))
+#define EvrOmRoundExit(id, round, received) ((void)(id), (void)(round), (void)(received))
+#define EvrOmRelayPut(id, receiver, round, msg) ((void)(id), (void)(receiver), (void)(round), (void)(msg))
+#define EvrOmRelayGet(id, round, msg) ((void)(id), (void)(round), (void)(msg))
+#define EvrOmResolve(id, level, nodes) ((void)(id), (void)(level), (void)(nodes))
+#define EvrOmDecision(id, decision) ((void)(id), (void)(decision))
+
+#endif
+
+#endif
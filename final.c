@@ -1,6 +1,19 @@
 #include <cmsis_os2.h>
 #include <stdlib.h>
+#include <string.h>
 #include "general.h"
+#include "traitor.h"
+#include "scheduling.h"
+#include "counters.h"
+#include "trace.h"
+#include "itm.h"
+#include "coin.h"
+#include "scenario.h"
+#include "frame.h"
+#include "RTE_Components.h"
+#ifdef RTE_Compiler_EventRecorder
+#include "EventRecorder.h"
+#endif
 
 typedef struct {
 	uint8_t n;
@@ -8,6 +21,7 @@ typedef struct {
 	uint8_t reporter;
 	char command;
 	uint8_t sender;
+	strategy_t strategy;
 } test_t;
 
 bool loyal0[] = { true, true, false };
@@ -25,7 +39,40 @@ bool loyal11[] = { false, true, true, false, true, true, true };//2 traitors 1 c
 bool loyal12[] = { true, true, true, true, false};//1 traitor 5 generals, traitor is commander
 bool loyal13[] = { false, true, true, true, true}; //1 traitor 5 generals, traitor is reciever
 
-#define N_TEST 14
+#define N_TEST 20
+#define TRAITOR_SEED 241
+#define COIN_SEED 2024
+#define COOPERATIVE false
+// Threads the generals share as coroutines, 0 for a thread per general, n is still at most 7
+#define WORKERS 0
+// Rounds go through the mailbox matrix instead of the message queues
+#define MAILBOX false
+// Each general sends one batch per receiver and round instead of a message per path
+#define AGGREGATE false
+// Randomized agreement with a common coin instead of OM's lockstep rounds
+#define RANDOMIZED false
+// PBFT's leader and view change instead of OM, for the same 4 to 7 generals
+#define PBFT false
+// Instances each test is timed with OM and with PBFT, 0 for no benchmark
+#define BENCHMARK 0
+// Every general commands at once and they agree on the vector of commands
+#define INTERACTIVE false
+// OM agrees on payload digests and the payload is fetched once per general
+#define DIGEST false
+// Bytes of the payload each test broadcasts in digest mode, its command and
+// then a pattern. 0 for the one byte command
+#define PAYLOAD 0
+// Plain OM messages are encoded and decoded with frame.h on their way, a
+// check of the codec on every relay rather than a transport
+#define FRAME_CODEC false
+// Prints a Chrome trace of every test after its results
+#define TRACE false
+// Runs every record of the linked scenario corpus after the tests
+#define CORPUS false
+// Workers the corpus runs on a second time, 0 to run it only once
+#define CORPUS_WORKERS 2
+// Results kept of the records that did not pass, the first ones win
+#define CORPUS_FAILURES 64
 
 test_t tests[N_TEST] = {
 	{ sizeof(loyal0)/sizeof(loyal0[0]), loyal0, 1, 'R', 0 },
@@ -41,21 +88,32 @@ test_t tests[N_TEST] = {
 	{ sizeof(loyal10)/sizeof(loyal10[0]), loyal10, 2, 'R', 4 },
 	{ sizeof(loyal11)/sizeof(loyal11[0]), loyal11, 3, 'R', 0 },
 	{ sizeof(loyal12)/sizeof(loyal12[0]), loyal12, 0, 'A', 4 },
-	{ sizeof(loyal13)/sizeof(loyal13[0]), loyal13, 2, 'R', 3 }
+	{ sizeof(loyal13)/sizeof(loyal13[0]), loyal13, 2, 'R', 3 },
+	{ sizeof(loyal3)/sizeof(loyal3[0]), loyal3, 6, 'R', 4, TRAITOR_RANDOM },
+	{ sizeof(loyal11)/sizeof(loyal11[0]), loyal11, 2, 'A', 0, TRAITOR_EQUIVOCATE },
+	{ sizeof(loyal10)/sizeof(loyal10[0]), loyal10, 2, 'A', 1, TRAITOR_TARGET_REPORTER },
+	{ sizeof(loyal6)/sizeof(loyal6[0]), loyal6, 2, 'R', 3, TRAITOR_SILENT },
+	{ sizeof(loyal10)/sizeof(loyal10[0]), loyal10, 2, 'A', 4, TRAITOR_DELAY },
+	{ sizeof(loyal3)/sizeof(loyal3[0]), loyal3, 6, 'A', 0, TRAITOR_FLOOD }
 
 };
 
 #define MAX_GENERALS 7
+#define STACK_MARGIN 64
 uint8_t ids[MAX_GENERALS] = { 0, 1, 2, 3, 4, 5, 6 };
 osThreadId_t generals[MAX_GENERALS];
 uint8_t nGeneral;
+uint8_t nWorkers;
+counters_t snapshot;
 
 void startGenerals(uint8_t n) {
-	nGeneral = n;
+	osThreadAttr_t attr = { 0 };
+	attr.stack_size = generalStackSize();
+	nGeneral = nWorkers ? nWorkers : n;
 	for(uint8_t i=0; i<nGeneral; i++) {
-		generals[i] = osThreadNew(general, ids + i, NULL);
+		generals[i] = osThreadNew(nWorkers ? worker : general, ids + i, &attr);
 		if(generals[i] == NULL) {
-			printf("failed to create general[%d]\n", i);
+			fmtPrintf("failed to create general[%d]\n", i);
 		}
 	}
 }
@@ -66,25 +124,326 @@ void stopGenerals(void) {
 	}
 }
 
+// Needs OS_STACK_WATERMARK so the kernel can tell how deep each stack went.
+// A stack that came within an exception frame of its end means the bound
+// in general.c is too low for this engine
+void reportStacks(void) {
+	for(uint8_t i=0; i<nGeneral; i++) {
+		uint32_t size = osThreadGetStackSize(generals[i]);
+		uint32_t space = osThreadGetStackSpace(generals[i]);
+		fmtPrintf("id: %d, stack used: %u of %u\n", i, size - space, size);
+		if(space < STACK_MARGIN) {
+			fmtPrintf("id: %d, stack bound too low, %u bytes left\n", i, space);
+		}
+	}
+}
+
+// OM runs one round more than there are traitors
+uint8_t traitorCount(test_t *test) {
+	uint8_t traitors = 0;
+	for(uint8_t i=0; i<test->n; i++) {
+		if(!test->loyal[i]) {
+			traitors++;
+		}
+	}
+	return traitors;
+}
+
+void setStrategies(test_t *test) {
+	for(uint8_t i=0; i<test->n; i++) {
+		if(!test->loyal[i]) {
+			setTraitorStrategy(i, test->strategy, 0);
+		}
+	}
+	if(test->strategy != TRAITOR_PARITY) {
+		fmtPrintf("traitor strategy: %s\n", strategyName(test->strategy));
+	}
+}
+
+// The test's commander sends its command and the others alternate. Loyal
+// generals must agree on the whole vector, with a loyal general's command
+// at its own position
+void broadcastVector(test_t *test) {
+	char commands[MAX_GENERALS];
+	uint8_t reference = 0;
+	uint32_t disagreements = 0;
+	for(uint8_t i=0; i<test->n; i++) {
+		commands[i] = i == test->sender ? test->command : (i % 2 ? ATTACK : RETREAT);
+	}
+	while(!test->loyal[reference]) {
+		reference++;
+	}
+	broadcastAll(commands);
+	for(uint8_t i=0; i<test->n; i++) {
+		for(uint8_t c=0; test->loyal[i] && c<test->n; c++) {
+			char expected = test->loyal[c] ? commands[c] : getVector(reference, c);
+			if(getVector(i, c) != expected) {
+				disagreements++;
+			}
+		}
+	}
+	fmtPrintf("vector disagreements: %u\n", disagreements);
+}
+
+uint8_t payload[PAYLOAD > 0 ? PAYLOAD : 1];
+
+// The test's command and then a pattern, PAYLOAD bytes in all
+void broadcastPattern(test_t *test) {
+	for(uint16_t i=0; i<PAYLOAD; i++) {
+		payload[i] = i == 0 ? test->command : (uint8_t)(31*i + test->sender);
+	}
+	broadcastPayload(payload, PAYLOAD, test->sender);
+}
+
+// Decisions per second of OM and of PBFT on a test, each over BENCHMARK
+// instances. Only broadcast() is timed, every instance gets its own setup()
+void benchmark(test_t *test) {
+	uint32_t cycles[2] = { 0, 0 };
+	uint32_t rate[2] = { 0, 0 };
+	setVerbose(false);
+	setRandomized(false);
+	setInteractive(false);
+	setDigest(false);
+	setCodecCheck(false);
+	for(uint8_t engine=0; engine<2; engine++) {
+		setPbft(engine == 1);
+		for(uint32_t run=0; run<BENCHMARK; run++) {
+			if(!setup(test->n, test->loyal, test->reporter)) {
+				cleanup();
+				break;
+			}
+			for(uint8_t i=0; i<test->n; i++) {
+				if(!test->loyal[i]) {
+					setTraitorStrategy(i, test->strategy, 0);
+				}
+			}
+			startGenerals(test->n);
+			uint32_t start = osKernelGetSysTimerCount();
+			broadcast(test->command, test->sender);
+			cycles[engine] += osKernelGetSysTimerCount() - start;
+			stopGenerals();
+			cleanup();
+		}
+		if(cycles[engine]) {
+			rate[engine] = (uint32_t)((uint64_t)BENCHMARK * osKernelGetSysTimerFreq() / cycles[engine]);
+		}
+	}
+	setPbft(PBFT);
+	setDigest(DIGEST);
+	setCodecCheck(FRAME_CODEC);
+	setRandomized(RANDOMIZED);
+	setInteractive(INTERACTIVE);
+	setVerbose(true);
+	fmtPrintf("n: %d, decisions per second, om: %u, pbft: %u\n", test->n, rate[0], rate[1]);
+}
+
+bool sameFrame(const frame_t *a, const frame_t *b) {
+	return a->instance == b->instance && a->round == b->round && a->pathLen == b->pathLen
+		&& memcmp(a->path, b->path, a->pathLen) == 0 && a->value == b->value;
+}
+
+// The codec of frame.h on its own: the CRC check value, a round trip, a
+// batch cut in two with noise in front, a flipped bit and a bad length.
+// Runs once before the test cases
+void testFrames(void) {
+	frame_t frames[3] = {
+		{ 1, 0, 1, { 0 }, ATTACK },
+		{ 1, 1, 2, { 0, 4 }, RETREAT },
+		{ 1, 2, 3, { 0, 4, 2 }, ATTACK }
+	};
+	frame_t out[3];
+	uint8_t wire[2 + 3*FRAME_MAX_SIZE];
+	frame_decoder_t decoder;
+	uint32_t failed = 0;
+	uint32_t length;
+
+	failed += !c_assert(frameCrc(0xFFFF, (const uint8_t *)"123456789", 9) == 0x29B1);
+
+	length = frameEncode(&frames[2], wire, sizeof(wire));
+	frameDecoderReset(&decoder);
+	failed += !c_assert(length == FRAME_SIZE(3));
+	failed += !c_assert(frameDecodeBatch(&decoder, wire, length, out, 3) == 1 && sameFrame(&frames[2], &out[0]));
+
+	// Noise and a stray sync byte before the batch, which is fed in two
+	// halves so the middle frame is finished by the second call
+	wire[0] = 0x00;
+	wire[1] = FRAME_SYNC;
+	length = 2 + frameEncodeBatch(frames, 3, wire + 2, sizeof(wire) - 2);
+	frameDecoderReset(&decoder);
+	uint32_t first = frameDecodeBatch(&decoder, wire, length/2, out, 3);
+	uint32_t decoded = first + frameDecodeBatch(&decoder, wire + length/2, length - length/2, out + first, 3 - first);
+	failed += !c_assert(decoded == 3 && sameFrame(&frames[0], &out[0]) && sameFrame(&frames[1], &out[1]) && sameFrame(&frames[2], &out[2]));
+
+	// A flipped bit in the first frame loses that frame only
+	length = frameEncodeBatch(frames, 2, wire, sizeof(wire));
+	wire[FRAME_SIZE(1) - 3] ^= 0x01;
+	frameDecoderReset(&decoder);
+	failed += !c_assert(frameDecodeBatch(&decoder, wire, length, out, 3) == 1 && sameFrame(&frames[1], &out[0]));
+	failed += !c_assert(decoder.crcErrors == 1);
+
+	// A length no frame can have is dropped before any body is read
+	length = frameEncode(&frames[0], wire, sizeof(wire));
+	wire[1] = FRAME_MAX_SIZE;
+	frameDecoderReset(&decoder);
+	failed += !c_assert(frameDecodeBatch(&decoder, wire, length, out, 3) == 0 && decoder.dropped == 1);
+
+	failed += !c_assert(frameEncode(&frames[2], wire, FRAME_SIZE(3) - 1) == 0);
+	fmtPrintf("frames: %u checks failed\n", failed);
+}
+
+scenario_result_t corpusFailures[CORPUS_FAILURES];
+
+// Runs one record and checks the loyal lieutenants against it
+scenario_status_t runScenario(const scenario_t *record, scenario_result_t *result) {
+	bool loyal[MAX_GENERALS];
+	uint8_t lieutenants, agreed;
+
+	result->decided = 0;
+	result->wrong = 0;
+	if(record->n > MAX_GENERALS || record->commander >= record->n || record->reporter >= record->n
+			|| record->strategy >= N_STRATEGIES || (record->command != ATTACK && record->command != RETREAT)) {
+		return SCENARIO_BAD_RECORD;
+	}
+	for(uint8_t i=0; i<record->n; i++) {
+		loyal[i] = (record->loyal >> i) & 1;
+	}
+	if(!setup(record->n, loyal, record->reporter)) {
+		cleanup();
+		return SCENARIO_SETUP_FAILED;
+	}
+	for(uint8_t i=0; i<record->n; i++) {
+		if(!loyal[i]) {
+			setTraitorStrategy(i, (strategy_t)record->strategy, 0);
+		}
+	}
+	startGenerals(record->n);
+	broadcast(record->command, record->commander);
+	stopGenerals();
+	cleanup();
+
+	lieutenants = record->loyal & ~(1u << record->commander) & ((1u << record->n) - 1);
+	for(uint8_t i=0; i<record->n; i++) {
+		if(getDecision(i) == ATTACK) {
+			result->decided |= 1u << i;
+		}
+	}
+	if(record->flags & SCENARIO_AGREE) {
+		// Whatever the first loyal lieutenant decided, the rest must match
+		agreed = (result->decided & lieutenants & -lieutenants) ? lieutenants : 0;
+		result->wrong = (result->decided ^ agreed) & lieutenants;
+	} else {
+		result->wrong = (result->decided ^ record->expected) & lieutenants;
+	}
+	return result->wrong ? SCENARIO_WRONG : SCENARIO_PASS;
+}
+
+/**
+ * Streams through the records of a corpus in place and keeps the results
+ * of the first CORPUS_FAILURES that did not pass in corpusFailures
+  */
+void runCorpus(const scenario_header_t *header, uint32_t size) {
+	const scenario_t *records = (const scenario_t *)(header + 1);
+	uint32_t count, failed = 0;
+	scenario_result_t result;
+
+	if(size < sizeof(*header) || memcmp(header->magic, SCENARIO_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != SCENARIO_VERSION || header->recordSize != sizeof(scenario_t)) {
+		fmtPrintf("\ncorpus: not a version %d corpus\n", SCENARIO_VERSION);
+		return;
+	}
+	count = (size - sizeof(*header)) / sizeof(scenario_t);
+	memset(corpusFailures, 0, sizeof(corpusFailures));
+	setVerbose(false);
+	setInteractive(false);
+	for(uint32_t i=0; i<count; i++) {
+		result.index = i;
+		result.status = runScenario(&records[i], &result);
+		if(result.status != SCENARIO_PASS) {
+			if(failed < CORPUS_FAILURES) {
+				corpusFailures[failed] = result;
+			}
+			failed++;
+		}
+	}
+	setVerbose(true);
+	fmtPrintf("\ncorpus: %u records, %u passed, %u failed\n", count, count - failed, failed);
+	for(uint32_t i=0; i<failed && i<CORPUS_FAILURES; i++) {
+		fmtPrintf("record %u: status %u, decided %u, wrong %u\n", corpusFailures[i].index,
+			corpusFailures[i].status, corpusFailures[i].decided, corpusFailures[i].wrong);
+	}
+}
+
+// Generals are coroutines on n workers from the next setup(), 0 for threads
+void useWorkers(uint8_t n) {
+	nWorkers = n;
+	setWorkers(n);
+}
+
 void testCases(void *arguments) {
+	seedTraitors(TRAITOR_SEED);
+	coinSeed(COIN_SEED);
+	setCooperative(COOPERATIVE);
+	useWorkers(WORKERS);
+	setMailbox(MAILBOX);
+	setAggregate(AGGREGATE);
+	setInteractive(INTERACTIVE);
+	setRandomized(RANDOMIZED);
+	setPbft(PBFT);
+	setDigest(DIGEST);
+	setCodecCheck(FRAME_CODEC);
+	traceEnable(TRACE);
+	testFrames();
 	for(int i=0; i<N_TEST; i++) {
-		printf("\ntest case %d\n", i);
+		fmtPrintf("\ntest case %d\n", i);
 		if(setup(tests[i].n, tests[i].loyal, tests[i].reporter)) {
+			setStrategies(&tests[i]);
 			startGenerals(tests[i].n);
-			broadcast(tests[i].command, tests[i].sender);
-			cleanup();
+			if(INTERACTIVE) {
+				broadcastVector(&tests[i]);
+			} else if(DIGEST && PAYLOAD > 0) {
+				broadcastPattern(&tests[i]);
+			} else {
+				broadcast(tests[i].command, tests[i].sender);
+			}
+			countersSnapshot(&snapshot);
+			reportCounters(&snapshot, tests[i].n, traitorCount(&tests[i]), omTraffic());
+			reportBarrier();
+			reportSched(nGeneral);
+			reportStacks();
+			reportItm(nGeneral);
+			traceDump();
 			stopGenerals();
-			
+			cleanup();
+			if(BENCHMARK) {
+				benchmark(&tests[i]);
+			}
 		} else {
-			printf(" setup failed\n");
+			fmtPrintf(" setup failed\n");
+			cleanup();
 		}
 	}
-	printf("\ndone\n");
+	if(CORPUS) {
+		runCorpus(&scenarioCorpus, scenarioCorpusSize);
+	}
+	// Again with the generals as coroutines, where a traitor's delay must
+	// not hold up the loyal generals sharing its worker
+	if(CORPUS && CORPUS_WORKERS && CORPUS_WORKERS != WORKERS && !RANDOMIZED && !PBFT && !DIGEST && !FRAME_CODEC) {
+		fmtPrintf("\ncorpus on %d workers", CORPUS_WORKERS);
+		useWorkers(CORPUS_WORKERS);
+		runCorpus(&scenarioCorpus, scenarioCorpusSize);
+		useWorkers(WORKERS);
+	}
+	fmtPrintf("\ndone\n");
 }
 
 /* main */
 int main(void) {
+#ifdef RTE_Compiler_EventRecorder
+	EventRecorderInitialize(EventRecordAll, 1);
+#endif
+	itmInit();
 	osKernelInitialize();
+	fmtInit();
   osThreadNew(testCases, NULL, NULL);
 	osKernelStart();
 	
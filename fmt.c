@@ -0,0 +1,136 @@
+#include <cmsis_os2.h>
+#include "fmt.h"
+#include "itm.h"
+#include "scheduling.h"
+
+#define MAX_GENERALS 7
+// One line buffer per registered thread plus one that every other thread
+// shares while it holds outputMutex
+#define FMT_THREADS (MAX_GENERALS+1)
+
+// Writes a character to the console of the build, Retarget.c
+extern int sendchar(int c);
+
+char lines[FMT_THREADS][FMT_LINE];
+osMutexId_t outputMutex;
+
+
+/**
+ * Creates the lock that keeps lines whole, after osKernelInitialize.
+ * Until then lines go out unlocked
+  */
+void fmtInit(void){
+	outputMutex = osMutexNew(NULL);
+}
+
+
+// Appends the digits of value, most significant first
+static size_t putUnsigned(char *buffer, size_t at, size_t size, unsigned value){
+	char digits[10];
+	int count = 0;
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (count && at < size)
+		buffer[at++] = digits[--count];
+	return at;
+}
+
+
+/**
+ * vsnprintf for the conversions this project prints: %d, %i, %u, %s, %c
+ * and %%, without flags, width or precision. Anything else is copied as it
+ * is. Returns the characters stored, at most size-1, always terminated
+  */
+int fmtFormat(char *buffer, size_t size, const char *format, va_list args){
+	size_t at = 0;
+	if (size == 0)
+		return 0;
+	size--;
+	for (; *format && at < size; format++){
+		if (*format != '%'){
+			buffer[at++] = *format;
+			continue;
+		}
+		switch (*++format){
+			case 'd':
+			case 'i': {
+				int value = va_arg(args, int);
+				if (value < 0){
+					buffer[at++] = '-';
+					at = putUnsigned(buffer, at, size, 0u - (unsigned)value);
+				}
+				else
+					at = putUnsigned(buffer, at, size, value);
+				break;
+			}
+			case 'u':
+				at = putUnsigned(buffer, at, size, va_arg(args, unsigned));
+				break;
+			case 'c':
+				buffer[at++] = (char)va_arg(args, int);
+				break;
+			case 's': {
+				const char *text = va_arg(args, const char *);
+				if (text == NULL)
+					text = "(null)";
+				while (*text && at < size)
+					buffer[at++] = *text++;
+				break;
+			}
+			case '%':
+				buffer[at++] = '%';
+				break;
+			case '\0':
+				format--;
+				break;
+			default:
+				buffer[at++] = '%';
+				if (at < size)
+					buffer[at++] = *format;
+				break;
+		}
+	}
+	buffer[at] = '\0';
+	return at;
+}
+
+
+int fmtSnprintf(char *buffer, size_t size, const char *format, ...){
+	va_list args;
+	int length;
+	va_start(args, format);
+	length = fmtFormat(buffer, size, format, args);
+	va_end(args);
+	return length;
+}
+
+
+/**
+ * printf into the calling thread's line buffer, which then goes to the
+ * console in one piece. Only the output holds the lock, so generals format
+ * in parallel and a line never interleaves with another. A general's lines
+ * go to its own stimulus port instead while the ITM is on; a worker's go to
+ * the port of the first general it steps
+  */
+int fmtPrintf(const char *format, ...){
+	int thread = schedIndex();
+	char *line = lines[thread < 0 ? MAX_GENERALS : thread];
+	va_list args;
+	int length;
+
+	if (thread < 0)
+		osMutexAcquire(outputMutex, osWaitForever);
+	va_start(args, format);
+	length = fmtFormat(line, FMT_LINE, format, args);
+	va_end(args);
+	if (thread >= 0 && itmEnabled(ITM_GENERAL(thread)))
+		return itmWrite(ITM_GENERAL(thread), line, length);
+	if (thread >= 0)
+		osMutexAcquire(outputMutex, osWaitForever);
+	for (int i = 0; i < length; i++)
+		sendchar(line[i]);
+	osMutexRelease(outputMutex);
+	return length;
+}
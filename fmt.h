@@ -0,0 +1,17 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// Longest line fmtPrintf writes, the rest is cut
+#ifndef FMT_LINE
+#define FMT_LINE 128
+#endif
+
+void fmtInit(void);
+int fmtFormat(char *buffer, size_t size, const char *format, va_list args);
+int fmtSnprintf(char *buffer, size_t size, const char *format, ...);
+int fmtPrintf(const char *format, ...);
+
+#endif
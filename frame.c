@@ -0,0 +1,184 @@
+#include "frame.h"
+
+#include <string.h>
+
+// Offsets into the part covered by LEN
+#define BODY_VERSION 0
+#define BODY_INSTANCE 1
+#define BODY_ROUND 2
+#define BODY_PATH_LEN 3
+#define BODY_PATH 4
+#define BODY_MIN 5
+
+enum { WAIT_SYNC, WAIT_LENGTH, IN_BODY, WAIT_CRC_HI, WAIT_CRC_LO };
+
+// CRC-16/CCITT, one table lookup per byte
+static const uint16_t crcTable[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+
+uint16_t frameCrc(uint16_t crc, const uint8_t *data, uint32_t len){
+	while (len--)
+		crc = (crc << 8) ^ crcTable[(crc >> 8) ^ *data++];
+	return crc;
+}
+
+
+/**
+ * Writes one frame into buf. Returns the bytes written, or 0 if it does
+ * not fit or the path is too long
+  */
+uint32_t frameEncode(const frame_t *frame, uint8_t *buf, uint32_t size){
+	uint32_t total = FRAME_SIZE(frame->pathLen);
+	if (frame->pathLen > FRAME_MAX_PATH || total > size)
+		return 0;
+	buf[0] = FRAME_SYNC;
+	buf[1] = BODY_MIN + frame->pathLen;
+	buf[2+BODY_VERSION] = FRAME_VERSION;
+	buf[2+BODY_INSTANCE] = frame->instance;
+	buf[2+BODY_ROUND] = frame->round;
+	buf[2+BODY_PATH_LEN] = frame->pathLen;
+	memcpy(buf + 2+BODY_PATH, frame->path, frame->pathLen);
+	buf[2+BODY_PATH+frame->pathLen] = frame->value;
+	uint16_t crc = frameCrc(0xFFFF, buf+1, total-3);
+	buf[total-2] = crc >> 8;
+	buf[total-1] = crc & 0xFF;
+	return total;
+}
+
+
+/**
+ * Writes a whole round back to back. Stops at the first frame that does
+ * not fit and returns the bytes written so far
+  */
+uint32_t frameEncodeBatch(const frame_t *frames, uint32_t count, uint8_t *buf, uint32_t size){
+	uint32_t used = 0;
+	for (uint32_t i = 0; i < count; i++){
+		uint32_t written = frameEncode(frames + i, buf + used, size - used);
+		if (written == 0)
+			break;
+		used += written;
+	}
+	return used;
+}
+
+
+void frameDecoderReset(frame_decoder_t *decoder){
+	memset(decoder, 0, sizeof(frame_decoder_t));
+	decoder->state = WAIT_SYNC;
+}
+
+
+// Checks the header of a body whose CRC matched and copies it out
+static bool unpack(const uint8_t *body, uint8_t length, frame_t *frame){
+	uint8_t pathLen = body[BODY_PATH_LEN];
+	if (body[BODY_VERSION] != FRAME_VERSION || pathLen > FRAME_MAX_PATH || length != BODY_MIN + pathLen)
+		return false;
+	frame->instance = body[BODY_INSTANCE];
+	frame->round = body[BODY_ROUND];
+	frame->pathLen = pathLen;
+	memcpy(frame->path, body + BODY_PATH, pathLen);
+	frame->value = body[BODY_PATH+pathLen];
+	return true;
+}
+
+
+/**
+ * Feeds one received byte to the decoder. Returns true when it completed
+ * a valid frame, which is then in *frame. Anything broken is counted and
+ * skipped up to the next sync byte
+  */
+bool frameDecodeByte(frame_decoder_t *decoder, uint8_t byte, frame_t *frame){
+	switch (decoder->state){
+	case WAIT_SYNC:
+		if (byte == FRAME_SYNC)
+			decoder->state = WAIT_LENGTH;
+		return false;
+	case WAIT_LENGTH:
+		if (byte < BODY_MIN || byte > BODY_MIN + FRAME_MAX_PATH){
+			decoder->dropped++;
+			decoder->state = byte == FRAME_SYNC ? WAIT_LENGTH : WAIT_SYNC;
+			return false;
+		}
+		decoder->length = byte;
+		decoder->count = 0;
+		decoder->crc = frameCrc(0xFFFF, &byte, 1);
+		decoder->state = IN_BODY;
+		return false;
+	case IN_BODY:
+		decoder->body[decoder->count++] = byte;
+		decoder->crc = (decoder->crc << 8) ^ crcTable[(decoder->crc >> 8) ^ byte];
+		if (decoder->count == decoder->length)
+			decoder->state = WAIT_CRC_HI;
+		return false;
+	case WAIT_CRC_HI:
+		if (byte != decoder->crc >> 8){
+			decoder->crcErrors++;
+			decoder->state = WAIT_SYNC;
+		}
+		else
+			decoder->state = WAIT_CRC_LO;
+		return false;
+	case WAIT_CRC_LO:
+		decoder->state = WAIT_SYNC;
+		if (byte != (decoder->crc & 0xFF)){
+			decoder->crcErrors++;
+			return false;
+		}
+		if (!unpack(decoder->body, decoder->length, frame)){
+			decoder->dropped++;
+			return false;
+		}
+		return true;
+	}
+	decoder->state = WAIT_SYNC;
+	return false;
+}
+
+
+/**
+ * Decodes every complete frame in buf, up to max of them. A frame cut off
+ * at the end of buf is kept in the decoder and finished by the next call.
+ * Frames are at least FRAME_OVERHEAD bytes, so len/FRAME_OVERHEAD of them
+ * never cuts a batch short
+  */
+uint32_t frameDecodeBatch(frame_decoder_t *decoder, const uint8_t *buf, uint32_t len, frame_t *frames, uint32_t max){
+	uint32_t decoded = 0;
+	for (uint32_t i = 0; i < len && decoded < max; i++){
+		if (frameDecodeByte(decoder, buf[i], frames + decoded))
+			decoded++;
+	}
+	return decoded;
+}
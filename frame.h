@@ -0,0 +1,45 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wire format of one message:
+//   SYNC | LEN | VERSION | INSTANCE | ROUND | PATH_LEN | PATH... | VALUE | CRC_HI | CRC_LO
+// LEN counts the bytes from VERSION to VALUE. The CRC-16/CCITT (0x1021,
+// initial 0xFFFF) covers LEN to VALUE, so a bad length is caught as well
+#define FRAME_SYNC 0x7E
+#define FRAME_VERSION 1
+#define FRAME_MAX_PATH 8
+#define FRAME_OVERHEAD 9
+#define FRAME_MAX_SIZE (FRAME_OVERHEAD + FRAME_MAX_PATH)
+#define FRAME_SIZE(pathLen) (FRAME_OVERHEAD + (pathLen))
+
+// A message off the wire, path is commander first like in the EIG
+typedef struct {
+	uint8_t instance;
+	uint8_t round;
+	uint8_t pathLen;
+	uint8_t path[FRAME_MAX_PATH];
+	char value;
+} frame_t;
+
+// Receive side of a link, fed one byte at a time from an ISR or a buffer
+typedef struct {
+	uint8_t state;
+	uint8_t length;
+	uint8_t count;
+	uint16_t crc;
+	uint8_t body[FRAME_MAX_SIZE];
+	uint32_t crcErrors;
+	uint32_t dropped;
+} frame_decoder_t;
+
+uint16_t frameCrc(uint16_t crc, const uint8_t *data, uint32_t len);
+uint32_t frameEncode(const frame_t *frame, uint8_t *buf, uint32_t size);
+uint32_t frameEncodeBatch(const frame_t *frames, uint32_t count, uint8_t *buf, uint32_t size);
+void frameDecoderReset(frame_decoder_t *decoder);
+bool frameDecodeByte(frame_decoder_t *decoder, uint8_t byte, frame_t *frame);
+uint32_t frameDecodeBatch(frame_decoder_t *decoder, const uint8_t *buf, uint32_t len, frame_t *frames, uint32_t max);
+
+#endif
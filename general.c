@@ -1,27 +1,308 @@
 #include <cmsis_os2.h>
 #include "general.h"
+#include "traitor.h"
+#include "barrier.h"
+#include "scheduling.h"
+#include "msgpool.h"
+#include "coroutine.h"
+#include "counters.h"
+#include "evr_om.h"
+#include "trace.h"
+#include "itm.h"
+#include "coin.h"
+#include "payload.h"
+#include "frame.h"
 
 // add any #includes here
 #include <stdlib.h>
-#include <stdio.h>
+#include "fmt.h"
 #include <string.h>
 
 // add any #defines here
 #define MAX_GENERALS 7
-#define QUEUE_SIZE 8
-#define MSG_PRIO NULL
-#define TIMEOUT 0
+#define MAX_ROUNDS 3
+#define MAX_NODES 20
+#define MSG_SIZE 8
+// Characters of the longest message for m traitors, "s:...:c:V" and the NUL
+#define MSG_TEXT(m) (2*(m)+4u)
+// Nodes a general relays in one round, at most those of EIG level m-1
+#define MAX_RELAYS (MAX_GENERALS-2)
+// A batch is BATCH_MARK, the sender and one value per node it relays
+#define BATCH_MARK '#'
+#define BATCH_SKIP '-'
+#define BATCH_TEXT(relays) ((relays)+3u)
+// A vector batch is VECTOR_MARK, the sender and then, for every commander in
+// id order, one value per node the sender relays in that commander's instance
+#define VECTOR_MARK '*'
+#define VECTOR_TEXT(n, relays) ((n)*(relays)+3u)
+// A vote of the randomized engine is its kind, the sender, the round in two
+// digits and the value, "E412A" being general 4's estimate A for round 12
+#define VOTE_EST 'E'
+#define VOTE_AUX 'X'
+#define VOTE_DECIDE 'D'
+#define VOTE_TEXT 6u
+// Inbox slots per general in randomized mode, where one queue takes every round
+#define VOTE_BACKLOG 4
+// A PBFT message is its kind, the sender, the view, the view of a reported
+// lock or PBFT_NONE, and the value, "V3214A" asks for view 2 holding a lock
+// on A from view 1. The commander's broadcast is the pre-prepare of view 0
+#define PBFT_PREPREPARE 'P'
+#define PBFT_PREPARE 'Q'
+#define PBFT_COMMIT 'C'
+#define PBFT_VIEWCHANGE 'V'
+#define PBFT_DECIDE 'D'
+#define PBFT_NONE '-'
+#define PBFT_VIEWS 10
+// Ticks a view gets before generals ask for the next one
+#define PBFT_VIEW_TICKS 20
+// Sent flags of a view
+#define PBFT_SENT_PREPARE 1
+#define PBFT_SENT_COMMIT 2
+#define PBFT_SENT_VIEWCHANGE 4
+#define PBFT_SENT_PREPREPARE 8
+// Digest batches are DIGEST_MARK, the sender and DIGEST_CHARS hex digits per
+// node it relays, BATCH_SKIP in all of them for a node left out. The
+// commander's digest goes out as "c:hhhhhhhh", as long as a one node batch
+#define DIGEST_MARK '$'
+#define DIGEST_CHARS 8
+#define DIGEST_TEXT(relays) (DIGEST_CHARS*(relays)+3u)
+#define DIGEST_NONE 0
+// What a traitor does to a digest it lies about, times the receiver plus one
+#define DIGEST_LIE 0x9E3779B9u
+#define MAILBOX_SLOT(round, value) ((uint16_t)(((round)+1) << 8) | (uint8_t)(value))
+#define MSG_PRIO 0
+#define TIMEOUT 100
+#define FINISH_SLACK 50
+
+// Worst-case stack of a general, estimated from the frames below: a
+// CALL_FRAME of saved registers plus each function's buffers. It never goes
+// below OS_STACK_SIZE of RTX_Config.h, which every general had before.
+// reportStacks() prints the watermarks, and util/stackbound.py holds the
+// linker's call graph against it. Update the frames with the engines
+#define DEFAULT_STACK 1024
+#define EXCEPTION_FRAME 64
+#define KERNEL_CALL_STACK 64
+#define CALL_FRAME 24
+#define GENERAL_FRAME 16
+#define OM_FRAME (40 + 3*MSG_SIZE)
+// batchFor(), vectorBatchFor() and digestBatchFor()
+#define RELAY_FRAME (CALL_FRAME + MAX_ROUNDS + MSG_SIZE + MAX(VECTOR_TEXT(MAX_GENERALS, MAX_RELAYS), DIGEST_TEXT(MAX_RELAYS)))
+// traitorDigest(), traitorSend() and the strategy
+#define TRAITOR_FRAME (3*CALL_FRAME)
+#define SEND_FRAME (24 + MSG_SIZE)
+#define STORE_FRAME (24 + MAX_ROUNDS + MSG_SIZE)
+#define RESOLVE_FRAME 32
+// fetchPayload(), payloadFetch() and payloadDigest()
+#define FETCH_FRAME (3*CALL_FRAME + 4)
+// checkStatus(), itmPrintf() with its line, fmtFormat() and putUnsigned().
+// fmtPrintf() keeps its line off the stack
+#define STATUS_FRAME (4*CALL_FRAME + ITM_LINE + 12)
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+// codecRoundTrip() with the frame encoded and decoded, then frameDecodeBatch()
+#define CODEC_FRAME (3*CALL_FRAME + FRAME_MAX_SIZE + sizeof(frame_t) + MSG_SIZE)
+// A put that drains our own inbox while the receiver's is full, or reports
+// that it failed, or first goes through the frame codec
+#define DELIVER_STACK (SEND_FRAME + MAX(MAX(CALL_FRAME + STORE_FRAME, STATUS_FRAME), CODEC_FRAME))
+#define OM_STACK (OM_FRAME + MAX(MAX(RELAY_FRAME + TRAITOR_FRAME, DELIVER_STACK), \
+	MAX(RESOLVE_FRAME, FETCH_FRAME)))
+// omRandom(), voteStep() and broadcastVote(), then putVote() delivers
+#define VOTE_STACK (3*CALL_FRAME + DELIVER_STACK)
+// omPbft(), pbftStep(), pbftEnter(), sendPbft() and broadcastVote()
+#define PBFT_STACK (5*CALL_FRAME + MSG_SIZE + DELIVER_STACK)
+// worker() and omStep() with the coroutine's relay buffers
+#define WORKER_STACK (CALL_FRAME + OM_STACK)
+#define ESTIMATED_STACK (GENERAL_FRAME + MAX(MAX(OM_STACK, VOTE_STACK), MAX(PBFT_STACK, WORKER_STACK)))
+#define GENERAL_STACK MAX(DEFAULT_STACK, (EXCEPTION_FRAME + KERNEL_CALL_STACK + ESTIMATED_STACK + 7) & ~7u)
 
 // add global variables here
-osMessageQueueId_t commandQueue[3][MAX_GENERALS];
+osMessageQueueId_t commandQueue[MAX_ROUNDS][MAX_GENERALS];
 uint8_t total_generals;
 uint8_t reporterGeneral;
+uint8_t commanderGeneral;
 uint8_t numTraitors;
 bool loyalGenerals[MAX_GENERALS];
 
-osSemaphoreId_t barrierSem;
-osMutexId_t printMutex;
-osSemaphoreId_t finishedSem;
+// EIG tree of every general as bit planes, one word per level and one bit
+// per node: eigReceived marks the nodes filled this instance, eigValue holds
+// ATTACK as 1. A node that never arrived reads as RETREAT. A level has at
+// most MAX_NODES nodes, which must fit the word
+typedef uint32_t eig_level_t;
+eig_level_t eigValue[MAX_GENERALS][MAX_ROUNDS];
+eig_level_t eigReceived[MAX_GENERALS][MAX_ROUNDS];
+char decision[MAX_GENERALS];
+uint32_t roundTimeout = TIMEOUT;
+uint32_t instanceStart;
+
+// Start of an instance, the end of every round and completion; the
+// parties are all generals plus the thread calling broadcast()
+barrier_t instanceBarrier;
+uint32_t broadcastGeneration;
+
+// Relay schedule of the current instance, built once by broadcast(): for
+// every general and every level it relays, the message with its value left
+// out and the set of generals already on the path, relayer included
+char relayText[MAX_GENERALS][MAX_ROUNDS-1][MAX_NODES][MSG_SIZE];
+uint8_t relayPath[MAX_GENERALS][MAX_ROUNDS-1][MAX_NODES];
+
+// Everything om() keeps in locals for one round, so a general can run as a
+// coroutine and give its worker up between any two messages
+typedef struct {
+	co_resume_t resume;
+	uint8_t round;
+	uint8_t pending;
+	uint8_t receiver;
+	uint8_t copy;
+	uint8_t copies;
+	uint16_t expected;
+	uint16_t received;
+	int node;
+	uint32_t wakeAt;
+	message_t *shared;
+	message_t *sendMsg;
+	char newMsg[MSG_SIZE];
+} coroutine_t;
+
+// Threads the generals run on when they are coroutines, 0 for a thread each
+uint8_t workers;
+coroutine_t coroutines[MAX_GENERALS];
+
+// A worker sleeps on WAKE_FLAG while all its generals are blocked. A put
+// sets it on the receiver's worker, and a get on the workers of the
+// generals in spaceWanted that found the inbox full
+#define WAKE_FLAG 0x1
+osThreadId_t workerThread[MAX_GENERALS];
+uint8_t spaceWanted[MAX_GENERALS];
+
+// Bulk-synchronous transport: the values of round r sit in mailbox[r%2], one
+// slot per sender, receiver and node the sender relays, in schedule order.
+// Senders fill their row before the round's barrier and receivers read their
+// column after it, so no slot is ever written and read at the same time. A
+// slot carries the round it was written for, which hides anything a sender
+// that missed its deadline left there two rounds earlier
+bool mailboxMode;
+bool aggregateMode;
+bool verbose = true;
+uint16_t mailbox[2][MAX_GENERALS][MAX_GENERALS][MAX_RELAYS];
+
+// Interactive consistency: one OM instance per commander, all in the same
+// rounds. The planes are indexed by commander first, and vectorDecision[id]
+// is what general id agreed each commander said, its own command included
+bool vectorMode;
+char vectorCommand[MAX_GENERALS];
+eig_level_t vectorValue[MAX_GENERALS][MAX_GENERALS][MAX_ROUNDS];
+eig_level_t vectorReceived[MAX_GENERALS][MAX_GENERALS][MAX_ROUNDS];
+char vectorDecision[MAX_GENERALS][MAX_GENERALS];
+
+// Randomized agreement with a common coin (Mostefaoui, Moumen and Raynal,
+// after Ben-Or and Rabin). There are no round barriers: a general moves on
+// once n-t others are through a round, so a slow one only delays itself.
+// Every vote a general saw is a bit per sender, one mask per value, value
+// index 1 being ATTACK. The commander's value arrives as in OM, in
+// eigValue[id][0]
+typedef struct {
+	uint8_t est[COIN_ROUNDS][2];
+	uint8_t aux[COIN_ROUNDS][2];
+	uint8_t binValues[COIN_ROUNDS];
+	uint8_t sent[COIN_ROUNDS];	// EST values we sent, VOTE_SENT_AUX once the AUX is out
+	uint8_t decide[2];
+	uint8_t decideSent;
+	uint8_t rounds;
+} vote_t;
+#define VOTE_SENT_AUX 4
+
+bool randomMode;
+char voteCommand;
+uint32_t coinInstance;
+vote_t votes[MAX_GENERALS];
+// Generals that decided and stopped reading their inbox
+volatile uint8_t voteHalted;
+
+// Leader-based agreement after PBFT: the primary of a view sends its value,
+// everyone sends PREPARE and, once n-t agree, COMMIT, and n-t COMMITs
+// decide. A primary that stalls is replaced after PBFT_VIEW_TICKS. Without
+// signed messages a NEW-VIEW cannot carry proof, so a general locks the
+// value it saw prepared and only takes another one from a later view when
+// t+1 view changes report a later lock on it. Messages for views we are not
+// in yet are filed like the randomized votes
+typedef struct {
+	uint8_t view;
+	uint32_t viewStart;
+	char offered[PBFT_VIEWS];	// what the primary sent, 0 before
+	uint8_t prepare[PBFT_VIEWS][2];
+	uint8_t commit[PBFT_VIEWS][2];
+	uint8_t viewChange[PBFT_VIEWS];
+	int8_t reportView[PBFT_VIEWS][MAX_GENERALS];
+	char reportValue[PBFT_VIEWS][MAX_GENERALS];
+	uint8_t sent[PBFT_VIEWS];
+	int8_t lockView;
+	char lockValue;
+	uint8_t decide[2];
+	uint8_t decideSent;
+} pbft_t;
+
+bool pbftMode;
+pbft_t replicas[MAX_GENERALS];
+
+// Multi-valued commands: OM agrees on the digest of the commander's payload,
+// in batches, and the payload itself is fetched once after the rounds. A
+// digest tree holds a digest per EIG node, eigReceived still marks the nodes
+// that arrived. The one-byte payload of broadcast() is a plain command
+bool digestMode;
+bool payloadGiven;
+uint32_t digestNode[MAX_GENERALS][MAX_ROUNDS][MAX_NODES];
+uint32_t digestDecision[MAX_GENERALS];
+
+// Codec check: every message is encoded as frame.h bytes and decoded again
+// on the sending thread before it is put, with a decoder per sender and
+// receiver. No byte leaves the chip, this only runs the codec on every
+// relay and lets a bad frame cost the message the way a link would
+bool codecMode;
+uint8_t codecInstance;
+frame_decoder_t codecDecoders[MAX_GENERALS][MAX_GENERALS];
+
+
+// Number of EIG nodes a general holds for a round: ordered picks of
+// round relays out of the n-2 generals that are neither it nor the commander
+uint16_t roundNodes(uint8_t round){
+	uint16_t nodes = 1;
+	for (uint8_t k = 0; k < round; k++)
+		nodes *= total_generals-2-k;
+	return nodes;
+}
+
+
+// Value of a node, RETREAT unless ATTACK arrived for it
+char eigGet(uint8_t id, uint8_t level, int node){
+	return (eigValue[id][level] >> node) & 1 ? ATTACK : RETREAT;
+}
+
+
+// Fills a node of a pair of planes unless something already arrived for it
+// this round, first message wins. Returns true if the node was still missing
+bool planeSet(eig_level_t* value, eig_level_t* received, int node, char v){
+	eig_level_t bit = 1u << node;
+	if (*received & bit)
+		return false;
+	*received |= bit;
+	if (v == ATTACK)
+		*value |= bit;
+	return true;
+}
+
+
+bool eigSet(uint8_t id, uint8_t level, int node, char value){
+	return planeSet(&eigValue[id][level], &eigReceived[id][level], node, value);
+}
+
+
+// Files a digest for a node, first message wins as for eigSet
+bool digestSet(uint8_t id, uint8_t level, int node, uint32_t digest){
+	if (!planeSet(&eigValue[id][level], &eigReceived[id][level], node, RETREAT))
+		return false;
+	digestNode[id][level][node] = digest;
+	return true;
+}
 
 
 /*
@@ -31,220 +312,1843 @@ bool setup(uint8_t nGeneral, bool loyal[], uint8_t reporter) {
 	total_generals = nGeneral;
 	reporterGeneral = reporter;
 	numTraitors = 0;
-	barrierSem = osSemaphoreNew(total_generals, 0, NULL);
-	finishedSem = osSemaphoreNew(total_generals-1, 0, NULL);
-	printMutex = osMutexNew(NULL);
-
-	
 	for (int i = 0; i< total_generals; i++){
 		loyalGenerals[i] = loyal[i];
 		if (!loyalGenerals[i]){
 			numTraitors++;
 		}
 	}
-		
+
+	// Checked before anything is allocated, so a refused test leaks nothing
 	c_assert(total_generals>3*numTraitors);
 	if (!(total_generals>3*numTraitors))
 		return false;
-	
-	
-	for (int i=0; i<3; ++i){
+	c_assert(numTraitors < MAX_ROUNDS);
+	if (!(numTraitors < MAX_ROUNDS))
+		return false;
+
+	barrierInit(&instanceBarrier, (workers ? workers : total_generals)+1);
+	broadcastGeneration = 0;
+	coinInstance = 0;
+	memset(workerThread, 0, sizeof(workerThread));
+	schedReset();
+	countersReset();
+	traceReset();
+	traitorReset(reporter);
+
+	// Each inbox holds one full round plus some room for duplicates. Every
+	// pool block is referenced from a queue or held by a sender about to
+	// put it, so the pool never needs more than the queues plus one a thread
+	uint32_t blocks = nGeneral+1;
+	for (int i=0; i<=numTraitors; ++i){
 		for (int j =0; j<nGeneral; j++){
-			commandQueue[i][j] = osMessageQueueNew(QUEUE_SIZE, sizeof(char)*8, NULL);
+			uint32_t slots = (randomMode || pbftMode) && i == 0 ? VOTE_BACKLOG*nGeneral : roundNodes(i)+nGeneral;
+			commandQueue[i][j] = osMessageQueueNew(slots, sizeof(message_t*), NULL);
+			blocks += slots;
 		}
 	}
-	return true; 
+	uint32_t text = MSG_TEXT(numTraitors);
+	if (aggregateMode && numTraitors > 0 && BATCH_TEXT(roundNodes(numTraitors-1)) > text)
+		text = BATCH_TEXT(roundNodes(numTraitors-1));
+	if (vectorMode && numTraitors > 0)
+		text = MAX(text, VECTOR_TEXT(nGeneral, roundNodes(numTraitors-1)));
+	if (randomMode || pbftMode)
+		text = MAX(text, VOTE_TEXT);
+	if (digestMode)
+		text = MAX(text, DIGEST_TEXT(numTraitors > 0 ? MAX(roundNodes(numTraitors-1), 1) : 1));
+	return poolInit(blocks, text);
 }
 
 
-/** 
+/**
  * Deletes any resources used and resets variables
   */
 void cleanup(void) {
-	for (int i =0; i< 3; i++){
+	for (int i =0; i< MAX_ROUNDS; i++){
 		for(int j=0; j<MAX_GENERALS; j++){
 			osMessageQueueDelete(commandQueue[i][j]);
+			commandQueue[i][j] = NULL;
 		}
 	}
-	osSemaphoreDelete(barrierSem);
-	osSemaphoreDelete(finishedSem);
-	osMutexDelete(printMutex);
-	memset(loyalGenerals, NULL, MAX_GENERALS*sizeof(bool));
-	
+	barrierDelete(&instanceBarrier);
+	poolDelete();
+	memset(loyalGenerals, 0, MAX_GENERALS*sizeof(bool));
+
 	total_generals = 0;
 	numTraitors = 0;
 	reporterGeneral = 0;
 }
 
 
+/**
+ * Stack each general needs for the test that was set up, so final.c can
+ * create the threads with exactly that much instead of OS_STACK_SIZE
+  */
+uint32_t generalStackSize(void) {
+	return GENERAL_STACK;
+}
+
+
+/**
+ * Runs the generals as coroutines on the given number of worker threads,
+ * or on a thread each for 0. Takes effect with the next setup()
+  */
+void setWorkers(uint8_t threads) {
+	workers = threads;
+}
+
+
+/**
+ * Moves the values of every round through the mailbox matrix instead of
+ * the message queues. Takes effect with the next broadcast()
+  */
+void setMailbox(bool enable) {
+	mailboxMode = enable;
+}
+
+
+/**
+ * Packs everything a general relays to one receiver in a round into a
+ * single batch message. Takes effect with the next setup()
+  */
+void setAggregate(bool enable) {
+	aggregateMode = enable;
+}
+
+
+/**
+ * Prints the broadcast and what the reporter got and decided, on by default.
+ * Batch runs turn it off and read the decisions with getDecision()
+  */
+void setVerbose(bool enable) {
+	verbose = enable;
+}
+
+
+// Decision of general id in the last broadcast(), RETREAT for the commander
+char getDecision(uint8_t id) {
+	return id < MAX_GENERALS ? decision[id] : RETREAT;
+}
+
+
+/**
+ * Runs broadcastAll() instances instead of broadcast() ones, with every
+ * general a commander. Takes effect with the next setup()
+  */
+void setInteractive(bool enable) {
+	vectorMode = enable;
+}
+
+
+/**
+ * Runs broadcast() instances with the randomized engine instead of OM, with
+ * the coin taken from coinSeed(). Takes effect with the next setup()
+  */
+void setRandomized(bool enable) {
+	randomMode = enable;
+}
+
+
+/**
+ * Runs broadcast() instances with the PBFT engine instead of OM. Takes
+ * effect with the next setup()
+  */
+void setPbft(bool enable) {
+	pbftMode = enable;
+}
+
+
+/**
+ * Runs every message of plain OM through frameEncode() and frameDecodeBatch()
+ * on its way to the receiver. Takes effect with the next broadcast()
+  */
+void setCodecCheck(bool enable) {
+	codecMode = enable;
+}
+
+
+/**
+ * Agrees on payload digests instead of commands, see broadcastPayload().
+ * Takes effect with the next setup()
+  */
+void setDigest(bool enable) {
+	digestMode = enable;
+}
+
+
+// Digest general id agreed on in the last broadcast, DIGEST_NONE if none
+uint32_t getDigest(uint8_t id) {
+	return id < MAX_GENERALS ? digestDecision[id] : DIGEST_NONE;
+}
+
+
+// View general id decided in during the last PBFT broadcast()
+uint8_t getView(uint8_t id) {
+	return id < MAX_GENERALS ? replicas[id].view : 0;
+}
+
+
+// True when the engine sends a message per EIG path and round, the traffic
+// omMessages() predicts. Batches, mailboxes, vectors, digests and votes differ
+bool omTraffic(void) {
+	return !mailboxMode && !aggregateMode && !vectorMode && !randomMode && !pbftMode && !digestMode;
+}
+
+
+// Rounds general id needed to decide in the last randomized broadcast()
+uint8_t getCoinRounds(uint8_t id) {
+	return id < MAX_GENERALS ? votes[id].rounds : 0;
+}
+
+
+// What general id agreed commander said in the last broadcastAll()
+char getVector(uint8_t id, uint8_t commander) {
+	return id < MAX_GENERALS && commander < MAX_GENERALS ? vectorDecision[id][commander] : RETREAT;
+}
+
+
+/**
+ * Sets how many ticks each round may take before missing messages are
+ * treated as RETREAT. broadcast() returns within (m+1) of these
+  */
+void setRoundTimeout(uint32_t ticks) {
+	roundTimeout = ticks;
+}
+
+
+// Goes to the general's own stimulus port when the ITM is on, which never
+// blocks, and otherwise to the console as one line
 void checkStatus(osStatus_t status, int numGeneral){
-	osMutexAcquire(printMutex, osWaitForever);
-	if (status == osOK);
-	else if (status == osErrorResource)
-		printf("OVF %i\n", numGeneral);
+	const char *format = "US %i\n";
+	if (status == osOK)
+		return;
+	if (status == osErrorResource || status == osErrorTimeout){
+		countOverflow(numGeneral);
+		format = "OVF %i\n";
+	}
+	if (itmEnabled(ITM_GENERAL(numGeneral))){
+		itmPrintf(ITM_GENERAL(numGeneral), format, numGeneral);
+		return;
+	}
+	fmtPrintf(format, numGeneral);
+}
+
+
+// Counts a message that made it into the receiver's inbox. The receiver may
+// have released it already, but every message of a round has the same size
+void countPut(uint8_t round, uint8_t sender, uint8_t receiver){
+	if (randomMode || pbftMode)
+		countSend(round, sender, VOTE_TEXT);
+	else if (vectorMode)
+		countSend(round, sender, round > 0 ? VECTOR_TEXT(total_generals, roundNodes(round-1)) : MSG_TEXT(0));
+	else if (digestMode)
+		countSend(round, sender, DIGEST_TEXT(round > 0 ? roundNodes(round-1) : 1));
 	else
-		printf("US %i\n", numGeneral);
-	osMutexRelease(printMutex);
+		countSend(round, sender, aggregateMode && round > 0 ? BATCH_TEXT(roundNodes(round-1)) : MSG_TEXT(round));
+	countDepth(round, receiver, osMessageQueueGetCount(commandQueue[round][receiver]));
+}
+
+
+// Ticks left until the end of a round, 0 once it has passed
+uint32_t roundTicksLeft(uint8_t round){
+	uint32_t elapsed = osKernelGetTickCount() - instanceStart;
+	uint32_t deadline = (round+1)*roundTimeout;
+	return elapsed < deadline ? deadline - elapsed : 0;
+}
+
+
+// Meets every other party at the end of a round. The barrier after the
+// last round is instance completion, which also covers resolving the tree
+osStatus_t roundBarrier(uint8_t round, uint32_t* generation){
+	uint32_t timeout = roundTicksLeft(round);
+	if (round >= numTraitors)
+		timeout += FINISH_SLACK;
+	schedRoundBoundary();
+	traceBegin(TRACE_BARRIER_WAIT, TRACE_NO_GENERAL, round);
+	osStatus_t status = barrierWait(&instanceBarrier, generation, timeout);
+	traceEnd(TRACE_BARRIER_WAIT, TRACE_NO_GENERAL, round);
+	return status;
 }
 
 
-// Saves who not to send to using the message, returns the size
-int checkMessage(char* msg, int* doNotSend){
-	int lastNum = 0;
-	int msgLength = sizeof(msg)/sizeof(msg[0])+1;
-	for (int charNum = 0; charNum < msgLength; charNum++){
-		if (msg[charNum] >= '0' && msg[charNum] <= '9'){
-			doNotSend[lastNum] = msg[charNum] - '0';
-			lastNum++;
+/**
+ * Prints how quickly waiters ran after the barrier released them
+  */
+void reportBarrier(void){
+	barrier_stats_t *stats = &instanceBarrier.stats;
+	uint32_t average = stats->wakeups ? stats->totalLatency / stats->wakeups : 0;
+	fmtPrintf("barrier wakeups: %u, avg: %u, max: %u cycles, timeouts: %u\n",
+		stats->wakeups, average, stats->maxLatency, stats->timeouts);
+}
+
+
+// Parses "s:...:c:V" into a commander-first path, returns the path length
+uint8_t checkMessage(const char* msg, uint8_t* path, char* value){
+	uint8_t reversed[MAX_ROUNDS];
+	uint8_t len = 0;
+	while (msg[0] >= '0' && msg[0] <= '9' && msg[1] == ':' && len < MAX_ROUNDS){
+		reversed[len++] = msg[0] - '0';
+		msg += 2;
+	}
+	if ((msg[0] != ATTACK && msg[0] != RETREAT) || msg[1] != '\0')
+		return 0;
+	*value = msg[0];
+	for (uint8_t k = 0; k < len; k++)
+		path[k] = reversed[len-1-k];
+	return len;
+}
+
+
+// Position of a commander-first path in the EIG level of general self, or -1
+// if the path repeats a general or passes through self
+int pathIndex(const uint8_t* path, uint8_t len, uint8_t self, uint8_t commander){
+	int index = 0;
+	uint16_t used = (1u << path[0]) | (1u << self);
+	if (path[0] != commander || commander == self)
+		return -1;
+	for (uint8_t k = 1; k < len; k++){
+		if (path[k] >= total_generals || (used & (1u << path[k])))
+			return -1;
+		uint8_t rank = 0;
+		for (uint8_t j = 0; j < path[k]; j++){
+			if (!(used & (1u << j)))
+				rank++;
+		}
+		index = index*(total_generals-1-k) + rank;
+		used |= 1u << path[k];
+	}
+	return index;
+}
+
+
+// Inverse of pathIndex
+void indexPath(int index, uint8_t len, uint8_t self, uint8_t commander, uint8_t* path){
+	uint8_t ranks[MAX_ROUNDS];
+	uint16_t used = (1u << commander) | (1u << self);
+	for (int k = len-1; k >= 1; k--){
+		ranks[k] = index % (total_generals-1-k);
+		index /= total_generals-1-k;
+	}
+	path[0] = commander;
+	for (uint8_t k = 1; k < len; k++){
+		uint8_t j = 0;
+		while (used & (1u << j))
+			j++;
+		for (uint8_t rank = ranks[k]; rank > 0; rank--){
+			j++;
+			while (used & (1u << j))
+				j++;
+		}
+		path[k] = j;
+		used |= 1u << j;
+	}
+}
+
+
+// Writes "s:...:c:V" for a commander-first path
+void formatMessage(char* msg, const uint8_t* path, uint8_t len, char value){
+	for (uint8_t k = 0; k < len; k++){
+		*msg++ = '0' + path[len-1-k];
+		*msg++ = ':';
+	}
+	*msg++ = value;
+	*msg = '\0';
+}
+
+
+// Fills the relay schedule for the commander that was just set, so om()
+// never has to work out paths or recipients while the rounds run
+void buildSchedule(void){
+	uint8_t path[MAX_ROUNDS];
+	for (uint8_t id = 0; id < total_generals; id++){
+		for (uint8_t level = 0; level < numTraitors; level++){
+			for (int node = 0; node < roundNodes(level); node++){
+				uint8_t onPath = 0;
+				indexPath(node, level+1, id, commanderGeneral, path);
+				path[level+1] = id;
+				for (uint8_t k = 0; k <= level+1; k++)
+					onPath |= 1u << path[k];
+				formatMessage(relayText[id][level][node], path, level+2, RETREAT);
+				relayPath[id][level][node] = onPath;
+			}
 		}
 	}
-	return lastNum;
 }
 
 
-/** 
+// Encodes a message from id to receiver as a frame, feeds the bytes to the
+// decoder of that pair and gives the receiver what came out. Drops the
+// receiver's reference to the original. NULL if the frame did not decode
+message_t* codecRoundTrip(uint8_t id, uint8_t round, uint8_t receiver, message_t* sendMsg){
+	uint8_t wire[FRAME_MAX_SIZE];
+	frame_t frame;
+	char text[MSG_SIZE];
+	uint32_t length = 0;
+	frame.instance = codecInstance;
+	frame.round = round;
+	frame.pathLen = checkMessage(sendMsg->text, frame.path, &frame.value);
+	if (frame.pathLen > 0)
+		length = frameEncode(&frame, wire, sizeof(wire));
+	msgRelease(sendMsg);
+	if (frameDecodeBatch(&codecDecoders[id][receiver], wire, length, &frame, 1) != 1
+			|| frame.instance != codecInstance || frame.round != round)
+		return NULL;
+	formatMessage(text, frame.path, frame.pathLen, frame.value);
+	return msgAlloc(text, 1, roundTicksLeft(round));
+}
+
+
+// Digest of a one byte command, which is what broadcast() sends in digest mode
+uint32_t commandDigest(char command){
+	return payloadDigest((const uint8_t *)&command, 1);
+}
+
+
+// Writes a digest as DIGEST_CHARS lowercase hex digits, without a terminator
+void formatDigest(char* out, uint32_t digest){
+	for (int k = DIGEST_CHARS-1; k >= 0; k--){
+		out[k] = "0123456789abcdef"[digest & 0xF];
+		digest >>= 4;
+	}
+}
+
+
+bool parseDigest(const char* text, uint32_t* digest){
+	*digest = 0;
+	for (uint8_t k = 0; k < DIGEST_CHARS; k++){
+		char c = text[k];
+		if (c >= '0' && c <= '9')
+			*digest = *digest << 4 | (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			*digest = *digest << 4 | (c - 'a' + 10);
+		else
+			return false;
+	}
+	return true;
+}
+
+
+// Digest a traitor sends instead of digest for one receiver, or whether it
+// sends at all. The strategies see ATTACK for the digest of the ATTACK
+// command and RETREAT for any other, and a changed value swaps the two
+// commands or garbles any other digest. msg is the message the value rides on
+uint32_t traitorDigest(uint8_t id, uint8_t receiver, uint8_t round, char* msg, uint32_t digest, uint8_t* copies){
+	char value = digest == commandDigest(ATTACK) ? ATTACK : RETREAT;
+	msg[strlen(msg)-1] = value;
+	*copies = traitorSend(id, receiver, round, msg);
+	if (msg[strlen(msg)-1] == value)
+		return digest;
+	if (digest == commandDigest(ATTACK))
+		return commandDigest(RETREAT);
+	if (digest == commandDigest(RETREAT))
+		return commandDigest(ATTACK);
+	return digest ^ DIGEST_LIE*(receiver+1);
+}
+
+
+// The commander's "c:hhhhhhhh" for one receiver, NULL if there is nothing
+// to send
+message_t* digestFor(uint8_t sender, uint8_t receiver, uint8_t* copies, uint32_t timeout){
+	char msg[DIGEST_TEXT(1)];
+	uint32_t digest = payloadGet(sender)->digest;
+	*copies = 1;
+	if (!loyalGenerals[sender]){
+		char proxy[4] = {'0' + sender, ':', RETREAT, '\0'};
+		digest = traitorDigest(sender, receiver, 0, proxy, digest, copies);
+	}
+	msg[0] = '0' + sender;
+	msg[1] = ':';
+	formatDigest(&msg[2], digest);
+	msg[2+DIGEST_CHARS] = '\0';
+	return *copies ? msgAlloc(msg, *copies, timeout) : NULL;
+}
+
+
+// Last round of an instance, digests take one more to fetch the payload
+uint8_t lastRound(void){
+	return numTraitors + (digestMode ? 1 : 0);
+}
+
+
+/**
+ * Broadcasts a payload of up to PAYLOAD_MAX bytes. OM agrees on its digest
+ * and every lieutenant then fetches it once, so the relays carry DIGEST_CHARS
+ * per node whatever the size. Needs setDigest(true) before setup()
+  */
+void broadcastPayload(const uint8_t* data, uint16_t length, uint8_t sender) {
+	if (!digestMode){
+		fmtPrintf("broadcastPayload needs digest mode\n");
+		return;
+	}
+	payloadReset();
+	if (!payloadStore(sender, data, length)){
+		fmtPrintf("payload of %u bytes is over %u\n", length, PAYLOAD_MAX);
+		return;
+	}
+	payloadGiven = true;
+	broadcast(length > 0 ? (char)data[0] : RETREAT, sender);
+	payloadGiven = false;
+}
+
+
+/**
  * Performs the initial broadcast from the commander to the other generals
   */
 
 void broadcast(char command, uint8_t sender) {
-	
+
 	bool loyal = loyalGenerals[sender];
 	char msg[4];
-	snprintf(msg, 4, "%d:%c", sender, command);
-	
-	printf("broadcast msg: %s, sender: %i, loyal: %i\n", msg, sender, loyal);
-	for (uint8_t numGeneral = 0; numGeneral<total_generals; numGeneral++){
+	fmtSnprintf(msg, 4, "%d:%c", sender, command);
+	if ((randomMode || pbftMode || digestMode) && (workers || mailboxMode)){
+		fmtPrintf("randomized, PBFT and digest modes need a thread per general and queues\n");
+		return;
+	}
+	if (codecMode && (workers || mailboxMode || aggregateMode || randomMode || pbftMode || digestMode)){
+		fmtPrintf("the codec check runs plain OM, on a thread per general\n");
+		return;
+	}
+	if (digestMode && !payloadGiven){
+		broadcastPayload((const uint8_t *)&command, 1, sender);
+		return;
+	}
+
+	if (verbose)
+		fmtPrintf("broadcast msg: %s, sender: %i, loyal: %i\n", msg, sender, loyal);
+	commanderGeneral = sender;
+	// Generals on workers book a delaying traitor's sleeps rather than
+	// take them; the commander sends from this thread and still sleeps
+	traitorDeferDelays(workers ? ((1u << total_generals) - 1) & ~(1u << sender) : 0);
+	memset(spaceWanted, 0, sizeof(spaceWanted));
+	memset(eigValue, 0, sizeof(eigValue));
+	memset(eigReceived, 0, sizeof(eigReceived));
+	memset(decision, RETREAT, sizeof(decision));
+	memset(votes, 0, sizeof(votes));
+	memset(digestNode, 0, sizeof(digestNode));
+	memset(digestDecision, 0, sizeof(digestDecision));
+	for (uint8_t from = 0; from < total_generals && codecMode; from++){
+		for (uint8_t to = 0; to < total_generals; to++)
+			frameDecoderReset(&codecDecoders[from][to]);
+	}
+	codecInstance++;
+	voteHalted = 0;
+	voteCommand = command;
+	buildSchedule();
+	instanceStart = osKernelGetTickCount();
+	EvrOmInstanceStart(sender, total_generals, numTraitors);
+	if (mailboxMode){
+		memset(mailbox, 0, sizeof(mailbox));
+		for (uint8_t numGeneral = 0; numGeneral<total_generals; numGeneral++){
+			char value[MSG_SIZE];
+			memcpy(value, msg, sizeof(msg));
+			if (numGeneral != sender && (loyal || traitorSend(sender, numGeneral, 0, value)))
+				mailbox[0][sender][numGeneral][0] = MAILBOX_SLOT(0, value[2]);
+		}
+	}
+	// A loyal commander's message is written once for all lieutenants
+	message_t *shared = loyal && !mailboxMode && !digestMode ? msgAlloc(msg, total_generals-1, roundTicksLeft(0)) : NULL;
+	for (uint8_t numGeneral = 0; numGeneral<total_generals && !mailboxMode; numGeneral++){
 		if (numGeneral != sender){
-			if (!loyal){
-				if(numGeneral % 2 == 0){
-					msg[strlen(msg)-1] = 'R';
-				}
-				else{
-					msg[strlen(msg)-1] = 'A';
-				}
+			message_t *sendMsg = shared;
+			uint8_t copies = 1;
+			if (digestMode)
+				sendMsg = digestFor(sender, numGeneral, &copies, roundTicksLeft(0));
+			else if (!loyal){
+				char value[MSG_SIZE];
+				memcpy(value, msg, sizeof(msg));
+				copies = traitorSend(sender, numGeneral, 0, value);
+				sendMsg = copies ? msgAlloc(value, copies, roundTicksLeft(0)) : NULL;
+			}
+			if (sendMsg == NULL){
+				if (copies)
+					checkStatus(osErrorResource, numGeneral);
+				continue;
 			}
-			osStatus_t status = osMessageQueuePut(commandQueue[0][numGeneral], &msg, MSG_PRIO, osWaitForever);
-			if (status != osOK){
-				checkStatus(status, numGeneral);
-				osMutexAcquire(printMutex, osWaitForever);
-				printf("not ok broadcast id: %i\n", numGeneral);
-				osMutexRelease(printMutex);
+			EvrOmRelayPut(sender, numGeneral, 0, sendMsg->text);
+			traceFlow('s', sender, 0, traceFlowId(0, numGeneral, sendMsg->text));
+			for (uint8_t copy = 0; copy < copies; copy++){
+				message_t *putMsg = codecMode ? codecRoundTrip(sender, 0, numGeneral, sendMsg) : sendMsg;
+				osStatus_t status = putMsg ? osMessageQueuePut(commandQueue[0][numGeneral], &putMsg, MSG_PRIO, roundTicksLeft(0)) : osError;
+				if (status != osOK){
+					checkStatus(status, numGeneral);
+					if (putMsg)
+						msgRelease(putMsg);
+				}
+				else
+					countPut(0, sender, numGeneral);
 			}
 		}
 	}
 
-	for (int i = 0; i<total_generals; i++){
-		osSemaphoreRelease(barrierSem);
+	// Starts the instance, then follows the rounds until completion,
+	// which is bounded by the last round's deadline. The randomized and
+	// PBFT engines only meet at completion, digests take one more round
+	// for the payload
+	barrierWait(&instanceBarrier, &broadcastGeneration, roundTicksLeft(0));
+	for (uint8_t round = randomMode || pbftMode ? numTraitors : 0; round <= lastRound(); round++){
+		if (roundBarrier(round, &broadcastGeneration) != osOK && round == lastRound())
+			fmtPrintf("generals missed the round deadline\n");
+	}
+
+	if (digestMode){
+		if (verbose && reporterGeneral != sender){
+			char digest[DIGEST_CHARS+1];
+			const payload_t *payload = payloadGet(reporterGeneral);
+			formatDigest(digest, digestDecision[reporterGeneral]);
+			digest[DIGEST_CHARS] = '\0';
+			fmtPrintf("id: %i, digest: %s, payload: %i bytes, moved: %u bytes\n", reporterGeneral, digest,
+				payloadHas(reporterGeneral, digestDecision[reporterGeneral]) ? payload->length : 0, payloadMoved());
+			fmtPrintf("id: %i, decision: %c\n", reporterGeneral, decision[reporterGeneral]);
+		}
+		return;
+	}
+
+	if (pbftMode){
+		if (verbose && reporterGeneral != sender)
+			fmtPrintf("id: %i, view: %i, decision: %c\n", reporterGeneral, replicas[reporterGeneral].view, decision[reporterGeneral]);
+		return;
+	}
+	if (randomMode){
+		coinInstance++;
+		if (verbose && reporterGeneral != sender)
+			fmtPrintf("id: %i, coin rounds: %i, decision: %c\n", reporterGeneral, votes[reporterGeneral].rounds, decision[reporterGeneral]);
+		return;
+	}
+
+	// Messages the reporter got in the last round, then its decision
+	if (verbose && reporterGeneral != sender){
+		uint8_t path[MAX_ROUNDS];
+		char visited[MSG_SIZE];
+		for (int node = 0; node < roundNodes(numTraitors); node++){
+			indexPath(node, numTraitors+1, reporterGeneral, commanderGeneral, path);
+			formatMessage(visited, path, numTraitors+1, eigGet(reporterGeneral, numTraitors, node));
+			fmtPrintf("id: %i, visited: %s\n", reporterGeneral, visited);
+		}
+		fmtPrintf("id: %i, decision: %c\n", reporterGeneral, decision[reporterGeneral]);
 	}
-	// Waits for all generals to finish OM before returning to final.c
-	for (int i = 0; i < total_generals-1; i++){
-		osSemaphoreAcquire(finishedSem, osWaitForever);
+	if (verbose && codecMode){
+		uint32_t crcErrors = 0, dropped = 0;
+		for (uint8_t from = 0; from < total_generals; from++){
+			for (uint8_t to = 0; to < total_generals; to++){
+				crcErrors += codecDecoders[from][to].crcErrors;
+				dropped += codecDecoders[from][to].dropped;
+			}
+		}
+		fmtPrintf("codec: %u crc errors, %u dropped\n", crcErrors, dropped);
 	}
 	return;
 }
 
 
-// The OM algorithm which runs recursively
-void om(char* msg, uint8_t id, uint8_t m){
-	if (m == 0){
-		if (id == reporterGeneral){
-			osMutexAcquire(printMutex, osWaitForever);
-			printf("id: %i, visited: %s\n", id, msg);
-			osMutexRelease(printMutex);
+/**
+ * Interactive consistency: every general broadcasts commands[id] at once and
+ * all of them agree on the whole vector. Needs setInteractive(true) before
+ * setup(), and the generals on threads of their own with queues
+  */
+void broadcastAll(const char* commands) {
+	if (!vectorMode || workers || mailboxMode || codecMode){
+		fmtPrintf("broadcastAll needs interactive mode, a thread per general and queues\n");
+		return;
+	}
+	char vector[MAX_GENERALS+1];
+	memcpy(vectorCommand, commands, total_generals);
+	memcpy(vector, commands, total_generals);
+	vector[total_generals] = '\0';
+	if (verbose)
+		fmtPrintf("broadcast all: %s\n", vector);
+	memset(vectorValue, 0, sizeof(vectorValue));
+	memset(vectorReceived, 0, sizeof(vectorReceived));
+	memset(vectorDecision, RETREAT, sizeof(vectorDecision));
+	instanceStart = osKernelGetTickCount();
+	EvrOmInstanceStart(reporterGeneral, total_generals, numTraitors);
+
+	barrierWait(&instanceBarrier, &broadcastGeneration, roundTicksLeft(0));
+	for (uint8_t round = 0; round <= numTraitors; round++){
+		if (roundBarrier(round, &broadcastGeneration) != osOK && round == numTraitors)
+			fmtPrintf("generals missed the round deadline\n");
+	}
+
+	if (verbose){
+		memcpy(vector, vectorDecision[reporterGeneral], total_generals);
+		fmtPrintf("id: %i, vector: %s\n", reporterGeneral, vector);
+	}
+}
+
+
+// Majority of every node's own value and its children, one level at a time
+// from the leaves up. The children of a node are a consecutive run of the
+// next level by the mixed-radix numbering of pathIndex, so their ATTACK votes
+// are one population count of a slice of the plane. Each level folds into a
+// plane of its own majorities
+char resolveTree(uint8_t id, const eig_level_t* planes){
+	eig_level_t majority = planes[numTraitors];
+	for (int level = numTraitors-1; level >= 0; level--){
+		uint8_t fanout = total_generals-2-level;
+		eig_level_t children = (1u << fanout) - 1;
+		eig_level_t folded = 0;
+		for (int node = 0; node < roundNodes(level); node++){
+			int attack = ((planes[level] >> node) & 1) + __builtin_popcount((majority >> (node*fanout)) & children);
+			if (2*attack > fanout+1)
+				folded |= 1u << node;
 		}
-		else return;
+		majority = folded;
+		EvrOmResolve(id, level, roundNodes(level));
 	}
-	if (m > 0){
-		int* doNotSend = (int*)malloc(MAX_GENERALS*sizeof(uint16_t));
-		int doNotSendSize = checkMessage(msg, doNotSend);
-		
-		// Message creation, and alteration (if traitor)
-		char newMsg[strlen(msg)+3];
-		snprintf(newMsg, strlen(msg)+3, "%d:%s", id, msg);
-		bool loyal = loyalGenerals[id];
-		
-		if (!loyal){
-			if(id % 2 == 0){
-				newMsg[strlen(newMsg)-1] = 'R';
+	return majority & 1 ? ATTACK : RETREAT;
+}
+
+
+char resolve(uint8_t id){
+	return resolveTree(id, eigValue[id]);
+}
+
+
+// Multi-valued resolve over the digest tree, folded in place from the leaves
+// up. A node takes the digest most of its own value and its children agree
+// on, DIGEST_NONE without a strict majority. The candidate is found with one
+// Boyer-Moore pass and then counted. Only the digest of the ATTACK command
+// decides ATTACK, every other digest is RETREAT with getDigest() naming it
+char resolveDigest(uint8_t id){
+	for (int level = numTraitors-1; level >= 0; level--){
+		uint8_t fanout = total_generals-2-level;
+		for (int node = 0; node < roundNodes(level); node++){
+			uint32_t *own = &digestNode[id][level][node];
+			const uint32_t *children = &digestNode[id][level+1][node*fanout];
+			uint32_t candidate = *own;
+			uint8_t count = 1;
+			for (uint8_t k = 0; k < fanout; k++){
+				if (count == 0){
+					candidate = children[k];
+					count = 1;
+				}
+				else if (children[k] == candidate)
+					count++;
+				else
+					count--;
 			}
-			else{
-				newMsg[strlen(newMsg)-1] = 'A';
+			count = *own == candidate;
+			for (uint8_t k = 0; k < fanout; k++)
+				count += children[k] == candidate;
+			*own = 2*count > fanout+1 ? candidate : DIGEST_NONE;
+		}
+		EvrOmResolve(id, level, roundNodes(level));
+	}
+	digestDecision[id] = digestNode[id][0][0];
+	return digestDecision[id] == commandDigest(ATTACK) ? ATTACK : RETREAT;
+}
+
+
+// Node of our level round that a sender's node k of its previous level
+// becomes once relayed, which is the order both batches and the mailbox
+// matrix use. -1 if there is no such node
+int relayNode(uint8_t id, uint8_t round, uint8_t sender, uint8_t commander, uint16_t k){
+	uint8_t path[MAX_ROUNDS];
+	if (sender >= total_generals || k >= roundNodes(round > 0 ? round-1 : 0))
+		return -1;
+	indexPath(k, round, sender, commander, path);
+	path[round] = sender;
+	return pathIndex(path, round+1, id, commander);
+}
+
+
+// Files the value a sender relayed for node k of its previous level. Returns
+// true if it filled a node of this round that was still missing
+bool fileRelay(uint8_t id, uint8_t round, uint8_t sender, uint16_t k, char value){
+	if (value != ATTACK && value != RETREAT)
+		return false;
+	int node = relayNode(id, round, sender, commanderGeneral, k);
+	return node >= 0 && eigSet(id, round, node, value);
+}
+
+
+// Unpacks a batch, returns how many missing nodes it filled
+uint16_t storeBatch(uint8_t id, uint8_t round, const char* batch){
+	uint16_t filled = 0;
+	uint8_t sender = batch[1] - '0';
+	for (uint16_t k = 0; round > 0 && batch[2+k] != '\0'; k++){
+		if (fileRelay(id, round, sender, k, batch[2+k]))
+			filled++;
+	}
+	return filled;
+}
+
+
+// Unpacks a vector batch into the trees of every instance, returns how many
+// missing nodes it filled. A batch of the wrong length is dropped whole
+uint16_t storeVector(uint8_t id, uint8_t round, const char* batch){
+	uint16_t filled = 0;
+	uint8_t sender = batch[1] - '0';
+	uint16_t relays = round > 0 ? roundNodes(round-1) : 0;
+	if (round == 0 || strlen(batch) != VECTOR_TEXT(total_generals, relays)-1)
+		return 0;
+	for (uint8_t commander = 0; commander < total_generals; commander++){
+		for (uint16_t k = 0; k < relays; k++){
+			char value = batch[2+commander*relays+k];
+			if (value != ATTACK && value != RETREAT)
+				continue;
+			int node = relayNode(id, round, sender, commander, k);
+			if (node >= 0 && planeSet(&vectorValue[commander][id][round], &vectorReceived[commander][id][round], node, value))
+				filled++;
+		}
+	}
+	return filled;
+}
+
+
+// Unpacks a digest batch, DIGEST_CHARS per slot, returns how many missing
+// nodes it filled. A batch of the wrong length is dropped whole
+uint16_t storeDigests(uint8_t id, uint8_t round, const char* batch){
+	uint16_t filled = 0;
+	uint8_t sender = batch[1] - '0';
+	uint16_t relays = round > 0 ? roundNodes(round-1) : 0;
+	if (round == 0 || strlen(batch) != DIGEST_TEXT(relays)-1)
+		return 0;
+	for (uint16_t k = 0; k < relays; k++){
+		uint32_t digest;
+		if (!parseDigest(&batch[2+k*DIGEST_CHARS], &digest))
+			continue;
+		int node = relayNode(id, round, sender, commanderGeneral, k);
+		if (node >= 0 && digestSet(id, round, node, digest))
+			filled++;
+	}
+	return filled;
+}
+
+
+// Files a vote, returns 1 if we had not seen it yet
+uint16_t storeVote(uint8_t id, const char* text){
+	vote_t *vote = &votes[id];
+	uint8_t sender = text[1] - '0';
+	uint8_t round = (text[2] - '0')*10 + (text[3] - '0');
+	uint8_t value = text[4] == ATTACK;
+	uint8_t *from;
+	if (sender >= total_generals || text[2] < '0' || text[2] > '9' || text[3] < '0' || text[3] > '9'
+			|| round >= COIN_ROUNDS || (text[4] != ATTACK && text[4] != RETREAT) || text[5] != '\0')
+		return 0;
+	if (text[0] == VOTE_EST)
+		from = &vote->est[round][value];
+	else if (text[0] == VOTE_AUX)
+		from = &vote->aux[round][value];
+	else if (text[0] == VOTE_DECIDE)
+		from = &vote->decide[value];
+	else
+		return 0;
+	if (*from & (1u << sender))
+		return 0;
+	*from |= 1u << sender;
+	return 1;
+}
+
+
+// Primary of a PBFT view, the commander first and then round the generals
+uint8_t pbftPrimary(uint8_t view){
+	return (commanderGeneral + view) % total_generals;
+}
+
+
+// Files a PBFT message, returns 1 if we had not seen it yet. Only the
+// primary's first offer of a view counts, and a lock reported with a view
+// change must be from an earlier view
+uint16_t storePbft(uint8_t id, const char* text){
+	pbft_t *replica = &replicas[id];
+	uint8_t sender = text[1] - '0';
+	uint8_t view = text[2] - '0';
+	uint8_t value = text[4] == ATTACK;
+	uint8_t *from;
+	if (sender >= total_generals || view >= PBFT_VIEWS || (text[4] != ATTACK && text[4] != RETREAT) || text[5] != '\0')
+		return 0;
+	if (text[0] == PBFT_PREPREPARE){
+		if (sender != pbftPrimary(view) || replica->offered[view])
+			return 0;
+		replica->offered[view] = text[4];
+		return 1;
+	}
+	if (text[0] == PBFT_VIEWCHANGE){
+		if (replica->viewChange[view] & (1u << sender))
+			return 0;
+		replica->viewChange[view] |= 1u << sender;
+		if (text[3] >= '0' && text[3] < '0' + view){
+			replica->reportView[view][sender] = text[3] - '0';
+			replica->reportValue[view][sender] = text[4];
+		}
+		return 1;
+	}
+	if (text[0] == PBFT_PREPARE)
+		from = &replica->prepare[view][value];
+	else if (text[0] == PBFT_COMMIT)
+		from = &replica->commit[view][value];
+	else if (text[0] == PBFT_DECIDE)
+		from = &replica->decide[value];
+	else
+		return 0;
+	if (*from & (1u << sender))
+		return 0;
+	*from |= 1u << sender;
+	return 1;
+}
+
+
+// Files a message from our own inbox into the EIG and drops our reference.
+// Returns how many nodes of this round that were still missing it filled
+uint16_t storeMessage(uint8_t id, uint8_t round, message_t* getMsg){
+	uint8_t path[MAX_ROUNDS];
+	char value;
+	uint16_t filled = 0;
+	uint8_t len = checkMessage(getMsg->text, path, &value);
+	countReceive(round, id, strlen(getMsg->text)+1);
+	EvrOmRelayGet(id, round, getMsg->text);
+	traceFlow('f', id, round, traceFlowId(round, id, getMsg->text));
+	if (getMsg->text[0] == BATCH_MARK)
+		filled = storeBatch(id, round, getMsg->text);
+	else if (getMsg->text[0] == VECTOR_MARK)
+		filled = storeVector(id, round, getMsg->text);
+	else if (getMsg->text[0] == DIGEST_MARK)
+		filled = storeDigests(id, round, getMsg->text);
+	else if (digestMode && round == 0){
+		uint32_t digest;
+		if (getMsg->text[0] == '0' + commanderGeneral && getMsg->text[1] == ':'
+				&& parseDigest(&getMsg->text[2], &digest) && getMsg->text[2+DIGEST_CHARS] == '\0')
+			filled = digestSet(id, 0, 0, digest);
+	}
+	else if (randomMode && len == 0)
+		filled = storeVote(id, getMsg->text);
+	else if (pbftMode && len == 0)
+		filled = storePbft(id, getMsg->text);
+	else if (vectorMode && len == 1 && round == 0){
+		// A commander's own value opens its instance
+		int node = pathIndex(path, len, id, path[0]);
+		filled = node >= 0 && planeSet(&vectorValue[path[0]][id][0], &vectorReceived[path[0]][id][0], node, value);
+	}
+	else if (len == round+1){
+		int node = pathIndex(path, len, id, commanderGeneral);
+		filled = node >= 0 && eigSet(id, round, node, value);
+	}
+	msgRelease(getMsg);
+	return filled;
+}
+
+
+// Files whatever is in our inbox right now
+void drainInbox(uint8_t id, uint8_t round, uint16_t* received){
+	message_t* getMsg;
+	while (osMessageQueueGet(commandQueue[round][id], &getMsg, NULL, 0) == osOK)
+		*received += storeMessage(id, round, getMsg);
+}
+
+
+// Wakes the worker that steps general id
+void wakeGeneral(uint8_t id){
+	if (workers && workerThread[id % workers] != NULL)
+		osThreadFlagsSet(workerThread[id % workers], WAKE_FLAG);
+}
+
+
+// Wakes the generals that found our inbox full, after we took from it
+void roomMade(uint8_t id){
+	uint8_t wanted = __sync_fetch_and_and(&spaceWanted[id], 0);
+	while (wanted){
+		wakeGeneral(__builtin_ctz(wanted));
+		wanted &= wanted - 1;
+	}
+}
+
+
+// Everything we relay to one receiver this round in schedule order, with
+// BATCH_SKIP for nodes whose path holds the receiver and for whatever a
+// traitor drops. NULL if there is nothing to send
+message_t* batchFor(uint8_t id, uint8_t round, uint8_t receiver, uint8_t* copies, uint32_t timeout){
+	char batch[BATCH_TEXT(MAX_RELAYS)];
+	bool any = false;
+	uint16_t relays = roundNodes(round-1);
+	batch[0] = BATCH_MARK;
+	batch[1] = '0' + id;
+	for (uint16_t node = 0; node < relays; node++){
+		char value[MSG_SIZE];
+		batch[2+node] = BATCH_SKIP;
+		if (relayPath[id][round-1][node] & (1u << receiver))
+			continue;
+		memcpy(value, relayText[id][round-1][node], MSG_SIZE);
+		value[2*(round+1)] = eigGet(id, round-1, node);
+		if (loyalGenerals[id] || traitorSend(id, receiver, round, value)){
+			batch[2+node] = value[2*(round+1)];
+			any = true;
+		}
+	}
+	batch[2+relays] = '\0';
+	*copies = any;
+	return any ? msgAlloc(batch, 1, timeout) : NULL;
+}
+
+
+// Everything we relay to one receiver this round across all instances, in
+// commander order and schedule order within each. The instances we command
+// and the receiver commands need nothing from us and are skipped whole
+message_t* vectorBatchFor(uint8_t id, uint8_t round, uint8_t receiver, uint8_t* copies, uint32_t timeout){
+	char batch[VECTOR_TEXT(MAX_GENERALS, MAX_RELAYS)];
+	bool any = false;
+	uint16_t relays = roundNodes(round-1);
+	batch[0] = VECTOR_MARK;
+	batch[1] = '0' + id;
+	for (uint8_t commander = 0; commander < total_generals; commander++){
+		for (uint16_t k = 0; k < relays; k++){
+			uint8_t path[MAX_ROUNDS];
+			char value[MSG_SIZE];
+			char *slot = &batch[2+commander*relays+k];
+			*slot = BATCH_SKIP;
+			if (commander == id || commander == receiver)
+				continue;
+			indexPath(k, round, id, commander, path);
+			path[round] = id;
+			if (memchr(path, receiver, round+1))
+				continue;
+			formatMessage(value, path, round+1, (vectorValue[commander][id][round-1] >> k) & 1 ? ATTACK : RETREAT);
+			if (loyalGenerals[id] || traitorSend(id, receiver, round, value)){
+				*slot = value[2*(round+1)];
+				any = true;
 			}
 		}
-		
-		// Send messages loop
-		for (int numGeneral = 0; numGeneral < total_generals; numGeneral++){
-			bool found = false;
-			if (numGeneral == id)
-				found = true;
-		
-			uint16_t i = 0;
-			while (!found && i < doNotSendSize){
-				int tmp = *(doNotSend+i);
-				if (numGeneral == tmp)
-					found = true;
-				i++;
-			}
-			
-			if (!found){
-				osMutexAcquire(printMutex, osWaitForever);
-				osStatus_t status = osMessageQueuePut(commandQueue[m][numGeneral], &newMsg, MSG_PRIO, osWaitForever);
-				uint32_t count = osMessageQueueGetCount(commandQueue[m][numGeneral]);
-				if (status != osOK){
-					printf("put wrong, count: %i, msg: %s\n", count, newMsg);
+	}
+	batch[2+total_generals*relays] = '\0';
+	*copies = any;
+	return any ? msgAlloc(batch, 1, timeout) : NULL;
+}
+
+
+// Digests we relay to one receiver this round in schedule order, laid out as
+// batchFor() does with a run of BATCH_SKIP for every slot left out
+message_t* digestBatchFor(uint8_t id, uint8_t round, uint8_t receiver, uint8_t* copies, uint32_t timeout){
+	char batch[DIGEST_TEXT(MAX_RELAYS)];
+	bool any = false;
+	uint16_t relays = roundNodes(round-1);
+	batch[0] = DIGEST_MARK;
+	batch[1] = '0' + id;
+	for (uint16_t node = 0; node < relays; node++){
+		char *slot = &batch[2+node*DIGEST_CHARS];
+		uint32_t digest = digestNode[id][round-1][node];
+		uint8_t sent = 1;
+		memset(slot, BATCH_SKIP, DIGEST_CHARS);
+		if (relayPath[id][round-1][node] & (1u << receiver))
+			continue;
+		if (!loyalGenerals[id]){
+			char value[MSG_SIZE];
+			memcpy(value, relayText[id][round-1][node], MSG_SIZE);
+			digest = traitorDigest(id, receiver, round, value, digest, &sent);
+		}
+		if (sent){
+			formatDigest(slot, digest);
+			any = true;
+		}
+	}
+	batch[2+relays*DIGEST_CHARS] = '\0';
+	*copies = any;
+	return any ? msgAlloc(batch, 1, timeout) : NULL;
+}
+
+
+// Relay of a node of the previous level with the value learnt for it. Loyal
+// relays share one block between everyone off the path
+message_t* relayShared(uint8_t id, uint8_t round, int node, char* newMsg, uint32_t timeout){
+	memcpy(newMsg, relayText[id][round-1][node], MSG_SIZE);
+	newMsg[2*(round+1)] = eigGet(id, round-1, node);
+	return loyalGenerals[id] ? msgAlloc(newMsg, total_generals-round-1, timeout) : NULL;
+}
+
+
+// Message for one receiver of a relay. Traitors decide per receiver what
+// (and how often) to send, copies 0 means nothing
+message_t* relayFor(uint8_t id, uint8_t round, uint8_t receiver, const char* newMsg, message_t* shared, uint8_t* copies, uint32_t timeout){
+	char value[MSG_SIZE];
+	*copies = 1;
+	if (loyalGenerals[id])
+		return shared;
+	memcpy(value, newMsg, MSG_SIZE);
+	*copies = traitorSend(id, receiver, round, value);
+	return *copies ? msgAlloc(value, *copies, timeout) : NULL;
+}
+
+
+// Puts a message for this round. While the receiver's inbox is full we drain
+// our own, so two generals flooding each other never wait on one another.
+// A message that could not be put gives back the receiver's reference
+osStatus_t sendMessage(uint8_t id, uint8_t round, uint8_t receiver, message_t* sendMsg, uint16_t* received){
+	if (codecMode && (sendMsg = codecRoundTrip(id, round, receiver, sendMsg)) == NULL)
+		return osError;
+	EvrOmRelayPut(id, receiver, round, sendMsg->text);
+	traceFlow('s', id, round, traceFlowId(round, receiver, sendMsg->text));
+	osStatus_t status = osMessageQueuePut(commandQueue[round][receiver], &sendMsg, MSG_PRIO, 0);
+	if (status == osErrorResource){
+		uint32_t blockedAt = osKernelGetSysTimerCount();
+		while (status == osErrorResource && roundTicksLeft(round) > 0){
+			drainInbox(id, round, received);
+			status = osMessageQueuePut(commandQueue[round][receiver], &sendMsg, MSG_PRIO, 1);
+		}
+		countBlockedPut(id, osKernelGetSysTimerCount() - blockedAt);
+	}
+	if (status != osOK)
+		msgRelease(sendMsg);
+	else
+		countPut(round, id, receiver);
+	return status;
+}
+
+
+// Get messages loop, until the round is complete or its deadline passes.
+// Whatever is still missing keeps the RETREAT default
+void awaitRound(uint8_t id, uint8_t round, uint16_t expected, uint16_t* received){
+	while (*received < expected){
+		message_t* getMsg;
+		uint32_t waitedAt = osKernelGetSysTimerCount();
+		traceBegin(TRACE_QUEUE_WAIT, id, round);
+		osStatus_t status = osMessageQueueGet(commandQueue[round][id], &getMsg, NULL, roundTicksLeft(round));
+		traceEnd(TRACE_QUEUE_WAIT, id, round);
+		countBlockedGet(id, osKernelGetSysTimerCount() - waitedAt);
+		if (status != osOK)
+			break;
+		*received += storeMessage(id, round, getMsg);
+	}
+}
+
+
+// Fetches the agreed payload once, from the commander or else from the first
+// lieutenant that holds it. Traitors serve through their strategies like a
+// relay, dropping the request or flipping a byte, and the next server is
+// tried. Returns whether general id holds the payload
+bool fetchPayload(uint8_t id, bool fromCommander){
+	uint32_t digest = digestDecision[id];
+	if (id == commanderGeneral || payloadHas(id, digest))
+		return true;
+	for (uint8_t server = 0; server < total_generals; server++){
+		char proxy[4] = {'0' + server, ':', ATTACK, '\0'};
+		uint8_t copies = 1;
+		if (server == id || fromCommander != (server == commanderGeneral) || !payloadHas(server, digest))
+			continue;
+		if (!loyalGenerals[server])
+			copies = traitorSend(server, id, lastRound(), proxy);
+		if (copies && payloadFetch(id, server, digest, proxy[2] != ATTACK))
+			return true;
+	}
+	return false;
+}
+
+
+// The OM algorithm as synchronous rounds: round 0 is the commander's value,
+// round r relays every path of length r to whoever is not on it yet
+void om(uint8_t id, uint32_t* generation){
+	for (uint8_t round = 0; round <= numTraitors; round++){
+		uint16_t expected = roundNodes(round);
+		uint16_t received = 0;
+		EvrOmRoundEnter(id, round);
+		traceBegin(TRACE_ROUND, id, round);
+
+		// Send messages loop, relaying everything learnt last round
+		// In aggregate and digest mode one pass sends a batch to every other general
+		if (round > 0){
+			bool batched = aggregateMode || digestMode;
+			for (int node = 0; node < (batched ? 1 : roundNodes(round-1)); node++){
+				char newMsg[MSG_SIZE];
+				uint8_t pending = ((1u << total_generals) - 1) & ~(batched ? 1u << id : relayPath[id][round-1][node]);
+				message_t *shared = batched ? NULL : relayShared(id, round, node, newMsg, roundTicksLeft(round));
+				while (pending){
+					uint8_t numGeneral = __builtin_ctz(pending);
+					uint8_t copies;
+					pending &= pending - 1;
+					message_t *sendMsg = digestMode ? digestBatchFor(id, round, numGeneral, &copies, roundTicksLeft(round))
+						: aggregateMode ? batchFor(id, round, numGeneral, &copies, roundTicksLeft(round))
+						: relayFor(id, round, numGeneral, newMsg, shared, &copies, roundTicksLeft(round));
+					if (sendMsg == NULL){
+						if (copies)
+							checkStatus(osErrorResource, numGeneral);
+						continue;
+					}
+					for (uint8_t copy = 0; copy < copies; copy++){
+						osStatus_t status = sendMessage(id, round, numGeneral, sendMsg, &received);
+						if (status != osOK)
+							checkStatus(status, numGeneral);
+					}
 				}
-				osMutexRelease(printMutex);
 			}
 		}
-		
-		// Get messages loop
-		for (int numGeneral = 0; numGeneral < total_generals; numGeneral++){
-			bool found = false;
+
+		awaitRound(id, round, expected, &received);
+		EvrOmRoundExit(id, round, received);
+		traceEnd(TRACE_ROUND, id, round);
+		if (round < numTraitors)
+			roundBarrier(round, generation);
+	}
+
+	traceBegin(TRACE_RESOLVE, id, numTraitors);
+	decision[id] = digestMode ? resolveDigest(id) : resolve(id);
+	traceEnd(TRACE_RESOLVE, id, numTraitors);
+	EvrOmDecision(id, decision[id]);
+	if (digestMode)
+		fetchPayload(id, true);
+	roundBarrier(numTraitors, generation);
+
+	// Whoever the commander did not serve fetches from a lieutenant that
+	// got the payload in the last round
+	if (digestMode){
+		fetchPayload(id, false);
+		roundBarrier(numTraitors+1, generation);
+	}
+}
+
+
+// Interactive consistency: om() with every general commanding an instance
+// of its own. Round 0 sends our command to everyone, each later round one
+// vector batch per receiver with the relays of all instances, so the rounds,
+// barriers and message count stay those of a single instance
+void omVector(uint8_t id, uint32_t* generation){
+	for (uint8_t round = 0; round <= numTraitors; round++){
+		uint16_t expected = (total_generals-1)*roundNodes(round);
+		uint16_t received = 0;
+		char msg[MSG_SIZE];
+		message_t *shared = NULL;
+		EvrOmRoundEnter(id, round);
+		traceBegin(TRACE_ROUND, id, round);
+
+		if (round == 0){
+			fmtSnprintf(msg, sizeof(msg), "%d:%c", id, vectorCommand[id]);
+			shared = loyalGenerals[id] ? msgAlloc(msg, total_generals-1, roundTicksLeft(0)) : NULL;
+		}
+		for (uint8_t numGeneral = 0; numGeneral < total_generals; numGeneral++){
+			uint8_t copies;
 			if (numGeneral == id)
-				found = true;
-		
-			uint16_t i = 0;
-			while (!found && i < doNotSendSize){
-				int tmp = *(doNotSend+i);
-				if (numGeneral == tmp)
-					found = true;
-				i++;
-			}
-			char getMsg[8];
-			if (!found){
-				osMutexAcquire(printMutex, osWaitForever);
-				osStatus_t status = osMessageQueueGet(commandQueue[m][numGeneral], &getMsg, MSG_PRIO, osWaitForever);
-				uint32_t count = osMessageQueueGetCount(commandQueue[m][numGeneral]);
+				continue;
+			message_t *sendMsg = round == 0 ? relayFor(id, 0, numGeneral, msg, shared, &copies, roundTicksLeft(0))
+				: vectorBatchFor(id, round, numGeneral, &copies, roundTicksLeft(round));
+			if (sendMsg == NULL){
+				if (copies)
+					checkStatus(osErrorResource, numGeneral);
+				continue;
+			}
+			for (uint8_t copy = 0; copy < copies; copy++){
+				osStatus_t status = sendMessage(id, round, numGeneral, sendMsg, &received);
 				if (status != osOK)
-					printf("get incorrect, count: %i, msg: %s\n", count, getMsg);
-				osMutexRelease(printMutex);
-				om(getMsg, numGeneral, m-1);
+					checkStatus(status, numGeneral);
+			}
+		}
+
+		awaitRound(id, round, expected, &received);
+		EvrOmRoundExit(id, round, received);
+		traceEnd(TRACE_ROUND, id, round);
+		if (round < numTraitors)
+			roundBarrier(round, generation);
+	}
+
+	traceBegin(TRACE_RESOLVE, id, numTraitors);
+	for (uint8_t commander = 0; commander < total_generals; commander++)
+		vectorDecision[id][commander] = commander == id ? vectorCommand[id] : resolveTree(id, vectorValue[commander][id]);
+	traceEnd(TRACE_RESOLVE, id, numTraitors);
+	roundBarrier(numTraitors, generation);
+}
+
+
+// Puts a vote into the receiver's inbox, the one of round 0, which takes the
+// whole instance. While it is full we drain our own, a tick at a time, until
+// the receiver takes the vote, halts or the instance deadline passes, the
+// way broadcast() waits out round 0. Nothing goes to a halted general
+void putVote(uint8_t id, uint8_t receiver, message_t* sendMsg){
+	uint16_t received = 0;
+	if (voteHalted & (1u << receiver)){
+		msgRelease(sendMsg);
+		return;
+	}
+	EvrOmRelayPut(id, receiver, 0, sendMsg->text);
+	traceFlow('s', id, 0, traceFlowId(0, receiver, sendMsg->text));
+	osStatus_t status = osMessageQueuePut(commandQueue[0][receiver], &sendMsg, MSG_PRIO, 0);
+	if (status == osErrorResource){
+		uint32_t blockedAt = osKernelGetSysTimerCount();
+		// A put that waits a tick and still finds the inbox full times out
+		while ((status == osErrorResource || status == osErrorTimeout)
+				&& roundTicksLeft(numTraitors) > 0 && !(voteHalted & (1u << receiver))){
+			drainInbox(id, 0, &received);
+			status = osMessageQueuePut(commandQueue[0][receiver], &sendMsg, MSG_PRIO, 1);
+		}
+		countBlockedPut(id, osKernelGetSysTimerCount() - blockedAt);
+	}
+	if (status != osOK){
+		if (!(voteHalted & (1u << receiver)))
+			checkStatus(status, receiver);
+		msgRelease(sendMsg);
+	}
+	else
+		countPut(0, id, receiver);
+}
+
+
+// Sends a vote to every other general. Traitors see the votes as rounds
+// from 1 on, round 0 being the commander's
+void broadcastVote(uint8_t id, uint8_t round, const char* msg){
+	uint32_t timeout = roundTicksLeft(numTraitors);
+	message_t *shared = loyalGenerals[id] ? msgAlloc(msg, total_generals-1, timeout) : NULL;
+	for (uint8_t numGeneral = 0; numGeneral < total_generals; numGeneral++){
+		uint8_t copies;
+		if (numGeneral == id)
+			continue;
+		// A traitor that sleeps before every send can run past the deadline
+		if (roundTicksLeft(numTraitors) == 0){
+			if (shared)
+				msgRelease(shared);
+			continue;
+		}
+		message_t *sendMsg = relayFor(id, round+1, numGeneral, msg, shared, &copies, timeout);
+		if (sendMsg == NULL){
+			if (copies)
+				checkStatus(osErrorResource, numGeneral);
+			continue;
+		}
+		for (uint8_t copy = 0; copy < copies; copy++)
+			putVote(id, numGeneral, sendMsg);
+	}
+}
+
+
+// Files a vote with our own and sends it to everyone else
+void sendVote(uint8_t id, char kind, uint8_t round, char value){
+	char msg[MSG_SIZE];
+	fmtSnprintf(msg, sizeof(msg), "%c%d%d%d%c", kind, id, round/10, round%10, value);
+	storeVote(id, msg);
+	broadcastVote(id, round, msg);
+}
+
+
+// Acts on the votes filed so far, one vote or round change at a time, and
+// returns false once there is nothing to do until more arrive. An estimate
+// t+1 others sent is echoed, and one 2t+1 sent joins binValues, whose first
+// value we send as AUX. n-t AUX votes within binValues end the round: a
+// single value becomes the estimate and is decided when the coin shows it,
+// two leave the estimate to the coin
+bool voteStep(uint8_t id, uint8_t* round, char* est){
+	vote_t *vote = &votes[id];
+	uint8_t r = *round;
+	for (uint8_t k = 0; k <= r && k < COIN_ROUNDS; k++){
+		for (uint8_t v = 0; v < 2; v++){
+			uint8_t count = __builtin_popcount(vote->est[k][v]);
+			if (count >= numTraitors+1 && !(vote->sent[k] & (1u << v))){
+				vote->sent[k] |= 1u << v;
+				sendVote(id, VOTE_EST, k, v ? ATTACK : RETREAT);
+				return true;
+			}
+			if (count >= 2*numTraitors+1)
+				vote->binValues[k] |= 1u << v;
+		}
+	}
+
+	if (r < COIN_ROUNDS && vote->binValues[r] && !(vote->sent[r] & VOTE_SENT_AUX)){
+		uint8_t v = vote->binValues[r] & (1u << (*est == ATTACK)) ? *est == ATTACK : __builtin_ctz(vote->binValues[r]);
+		vote->sent[r] |= VOTE_SENT_AUX;
+		sendVote(id, VOTE_AUX, r, v ? ATTACK : RETREAT);
+		return true;
+	}
+	if (r < COIN_ROUNDS && (vote->sent[r] & VOTE_SENT_AUX)){
+		uint8_t senders = 0, values = 0;
+		for (uint8_t v = 0; v < 2; v++){
+			if ((vote->binValues[r] & (1u << v)) && vote->aux[r][v]){
+				senders |= vote->aux[r][v];
+				values |= 1u << v;
+			}
+		}
+		if (__builtin_popcount(senders) >= total_generals-numTraitors){
+			char coin = coinFlip(coinInstance, r);
+			*est = values == 3 ? coin : values == 2 ? ATTACK : RETREAT;
+			if (values != 3 && *est == coin && !vote->decideSent){
+				vote->decideSent = 1;
+				sendVote(id, VOTE_DECIDE, 0, *est);
+			}
+			EvrOmRoundExit(id, r, __builtin_popcount(senders));
+			*round = ++r;
+			if (r < COIN_ROUNDS){
+				EvrOmRoundEnter(id, r);
+				vote->sent[r] |= 1u << (*est == ATTACK);
+				sendVote(id, VOTE_EST, r, *est);
+			}
+			return true;
+		}
+	}
+
+	// A decision t+1 others sent is echoed, so everyone gets to 2t+1
+	for (uint8_t v = 0; v < 2; v++){
+		if (__builtin_popcount(vote->decide[v]) >= numTraitors+1 && !vote->decideSent){
+			vote->decideSent = 1;
+			sendVote(id, VOTE_DECIDE, 0, v ? ATTACK : RETREAT);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// The randomized engine. Lieutenants start from the commander's value, which
+// they wait for as long as OM's round 0 would, the commander from its own
+// command. Then votes are sent and filed until 2t+1 generals decided the
+// same value, which is safe to stop on, or the instance deadline passed
+void omRandom(uint8_t id, uint32_t* generation){
+	vote_t *vote = &votes[id];
+	uint8_t round = 0;
+	char est = voteCommand;
+	char decided = 0;
+	message_t* getMsg;
+	traceBegin(TRACE_ROUND, id, 0);
+	EvrOmRoundEnter(id, 0);
+	while (id != commanderGeneral && !(eigReceived[id][0] & 1)
+			&& osMessageQueueGet(commandQueue[0][id], &getMsg, NULL, roundTicksLeft(0)) == osOK)
+		storeMessage(id, 0, getMsg);
+	if (id != commanderGeneral)
+		est = eigGet(id, 0, 0);
+	vote->sent[0] |= 1u << (est == ATTACK);
+	sendVote(id, VOTE_EST, 0, est);
+
+	while (!decided){
+		for (uint8_t v = 0; v < 2; v++){
+			if (__builtin_popcount(vote->decide[v]) >= 2*numTraitors+1)
+				decided = v ? ATTACK : RETREAT;
+		}
+		if (decided || voteStep(id, &round, &est))
+			continue;
+		uint32_t waitedAt = osKernelGetSysTimerCount();
+		traceBegin(TRACE_QUEUE_WAIT, id, 0);
+		osStatus_t status = osMessageQueueGet(commandQueue[0][id], &getMsg, NULL, roundTicksLeft(numTraitors));
+		traceEnd(TRACE_QUEUE_WAIT, id, 0);
+		countBlockedGet(id, osKernelGetSysTimerCount() - waitedAt);
+		if (status != osOK)
+			break;
+		storeMessage(id, 0, getMsg);
+	}
+	voteHalted |= 1u << id;
+	vote->rounds = round+1;
+	decision[id] = decided ? decided : est;
+	traceEnd(TRACE_ROUND, id, 0);
+	EvrOmDecision(id, decision[id]);
+	roundBarrier(numTraitors, generation);
+}
+
+
+// Files a PBFT message with our own and sends it to everyone else. lockView
+// is only reported with a view change, -1 for none
+void sendPbft(uint8_t id, char kind, uint8_t view, int8_t lockView, char value){
+	char msg[MSG_SIZE];
+	fmtSnprintf(msg, sizeof(msg), "%c%d%d%c%c", kind, id, view, lockView < 0 ? PBFT_NONE : '0' + lockView, value);
+	storePbft(id, msg);
+	broadcastVote(id, view+1, msg);
+}
+
+
+// View changes for a view that report a lock on value from after view above
+uint8_t pbftReports(const pbft_t* replica, uint8_t view, char value, int8_t above){
+	uint8_t reports = 0;
+	for (uint8_t sender = 0; sender < total_generals; sender++){
+		if ((replica->viewChange[view] & (1u << sender)) && replica->reportView[view][sender] > above
+				&& replica->reportValue[view][sender] == value)
+			reports++;
+	}
+	return reports;
+}
+
+
+// Value we start from: the command for the commander, whatever it sent us
+// for everyone else
+char pbftDefault(uint8_t id){
+	return id == commanderGeneral ? voteCommand : eigGet(id, 0, 0);
+}
+
+
+// Moves to a later view and asks everyone else to, with our lock
+void pbftEnter(uint8_t id, uint8_t view){
+	pbft_t *replica = &replicas[id];
+	EvrOmRoundExit(id, replica->view, 0);
+	replica->view = view;
+	replica->viewStart = osKernelGetTickCount();
+	replica->sent[view] |= PBFT_SENT_VIEWCHANGE;
+	EvrOmRoundEnter(id, view);
+	sendPbft(id, PBFT_VIEWCHANGE, view, replica->lockView, replica->lockView >= 0 ? replica->lockValue : RETREAT);
+}
+
+
+// Acts on the messages filed so far, one message or view change at a time,
+// and returns false once there is nothing to do until more arrive
+bool pbftStep(uint8_t id){
+	pbft_t *replica = &replicas[id];
+	uint8_t view = replica->view;
+	uint8_t quorum = total_generals - numTraitors;
+	char offer = replica->offered[view];
+
+	// A prepared certificate is the primary's offer and n-t generals on it,
+	// the primary included. The latest one we saw is our lock
+	for (uint8_t v = 0; v <= view; v++){
+		uint8_t x = replica->offered[v] == ATTACK;
+		if (replica->offered[v] && (int8_t)v > replica->lockView
+				&& __builtin_popcount(replica->prepare[v][x] | (1u << pbftPrimary(v))) >= quorum){
+			replica->lockView = v;
+			replica->lockValue = replica->offered[v];
+		}
+	}
+
+	// PREPARE an offer that agrees with our lock or that t+1 others report a
+	// later lock on, COMMIT once it is prepared
+	if (offer && id != pbftPrimary(view) && !(replica->sent[view] & PBFT_SENT_PREPARE)
+			&& (replica->lockView < 0 || replica->lockValue == offer || pbftReports(replica, view, offer, replica->lockView) >= numTraitors+1)){
+		replica->sent[view] |= PBFT_SENT_PREPARE;
+		sendPbft(id, PBFT_PREPARE, view, -1, offer);
+		return true;
+	}
+	if (offer && replica->lockView == view && !(replica->sent[view] & PBFT_SENT_COMMIT)){
+		replica->sent[view] |= PBFT_SENT_COMMIT;
+		sendPbft(id, PBFT_COMMIT, view, -1, offer);
+		return true;
+	}
+
+	// n-t COMMITs in any view decide, and lock us on the value, and so do
+	// t+1 others' decisions. We keep taking part in view changes after
+	// that, as the others may need us for their quorum
+	for (uint8_t x = 0; x < 2 && !replica->decideSent; x++){
+		bool committed = __builtin_popcount(replica->decide[x]) >= numTraitors+1;
+		for (uint8_t v = 0; v < PBFT_VIEWS && !committed; v++){
+			committed = __builtin_popcount(replica->commit[v][x]) >= quorum;
+			if (committed && (int8_t)v > replica->lockView){
+				replica->lockView = v;
+				replica->lockValue = x ? ATTACK : RETREAT;
+			}
+		}
+		if (committed){
+			replica->decideSent = 1;
+			sendPbft(id, PBFT_DECIDE, 0, -1, x ? ATTACK : RETREAT);
+			return true;
+		}
+	}
+
+	// Leave a view that timed out, or that t+1 others already left
+	for (uint8_t v = PBFT_VIEWS-1; v > view; v--){
+		if (__builtin_popcount(replica->viewChange[v]) >= numTraitors+1){
+			pbftEnter(id, v);
+			return true;
+		}
+	}
+	if (view+1 < PBFT_VIEWS && osKernelGetTickCount() - replica->viewStart >= PBFT_VIEW_TICKS){
+		pbftEnter(id, view+1);
+		return true;
+	}
+
+	// The new primary offers, once n-t asked for its view, the value t+1
+	// of them report the latest lock on, else its own lock or value
+	if (view > 0 && id == pbftPrimary(view) && !(replica->sent[view] & PBFT_SENT_PREPREPARE)
+			&& __builtin_popcount(replica->viewChange[view]) >= quorum){
+		char choice = replica->lockView >= 0 ? replica->lockValue : pbftDefault(id);
+		if (pbftReports(replica, view, choice == ATTACK ? RETREAT : ATTACK, replica->lockView) >= numTraitors+1)
+			choice = choice == ATTACK ? RETREAT : ATTACK;
+		replica->sent[view] |= PBFT_SENT_PREPREPARE;
+		sendPbft(id, PBFT_PREPREPARE, view, -1, choice);
+		return true;
+	}
+	return false;
+}
+
+
+// The PBFT engine. The commander's broadcast is the offer of view 0, and
+// generals stop like the randomized ones, once 2t+1 decided the same value.
+// One that is still undecided at the deadline keeps its lock
+void omPbft(uint8_t id, uint32_t* generation){
+	pbft_t *replica = &replicas[id];
+	char decided = 0;
+	message_t* getMsg;
+	memset(replica, 0, sizeof(*replica));
+	memset(replica->reportView, -1, sizeof(replica->reportView));
+	replica->lockView = -1;
+	replica->viewStart = instanceStart;
+	if (id == commanderGeneral)
+		replica->offered[0] = voteCommand;
+	traceBegin(TRACE_ROUND, id, 0);
+	EvrOmRoundEnter(id, 0);
+
+	while (!decided){
+		for (uint8_t x = 0; x < 2; x++){
+			if (__builtin_popcount(replica->decide[x]) >= 2*numTraitors+1)
+				decided = x ? ATTACK : RETREAT;
+		}
+		if (!replica->offered[0] && (eigReceived[id][0] & 1))
+			replica->offered[0] = eigGet(id, 0, 0);
+		if (decided || pbftStep(id))
+			continue;
+		uint32_t timeout = roundTicksLeft(numTraitors);
+		uint32_t elapsed = osKernelGetTickCount() - replica->viewStart;
+		if (replica->view+1 < PBFT_VIEWS)
+			timeout = MIN(timeout, elapsed < PBFT_VIEW_TICKS ? PBFT_VIEW_TICKS - elapsed : 0);
+		uint32_t waitedAt = osKernelGetSysTimerCount();
+		traceBegin(TRACE_QUEUE_WAIT, id, 0);
+		osStatus_t status = osMessageQueueGet(commandQueue[0][id], &getMsg, NULL, timeout);
+		traceEnd(TRACE_QUEUE_WAIT, id, 0);
+		countBlockedGet(id, osKernelGetSysTimerCount() - waitedAt);
+		if (status == osOK)
+			storeMessage(id, 0, getMsg);
+		else if (roundTicksLeft(numTraitors) == 0)
+			break;
+	}
+	voteHalted |= 1u << id;
+	decision[id] = decided ? decided : replica->lockView >= 0 ? replica->lockValue : pbftDefault(id);
+	EvrOmRoundExit(id, replica->view, 0);
+	traceEnd(TRACE_ROUND, id, 0);
+	EvrOmDecision(id, decision[id]);
+	roundBarrier(numTraitors, generation);
+}
+
+
+// Moves a coroutine's wake-up back by the delay its traitor booked. As with
+// a sleep, the delay counts from now when the last wake-up has passed
+uint32_t delayedWake(uint8_t id, uint32_t wakeAt){
+	uint32_t delay = traitorTakeDelay(id);
+	uint32_t now = osKernelGetTickCount();
+	if (delay == 0)
+		return wakeAt;
+	return ((int32_t)(wakeAt - now) > 0 ? wakeAt : now) + delay;
+}
+
+
+// Ticks a worker may sleep until one of its generals has to be stepped
+// again for a wake-up or the round's deadline
+uint32_t workerTimeout(uint8_t index, uint8_t round){
+	uint32_t timeout = roundTicksLeft(round);
+	uint32_t now = osKernelGetTickCount();
+	for (uint8_t id = index; id < total_generals; id += workers){
+		int32_t wake = (int32_t)(coroutines[id].wakeAt - now);
+		if (id != commanderGeneral && coroutines[id].round == round && wake > 0 && (uint32_t)wake < timeout)
+			timeout = (uint32_t)wake;
+	}
+	return timeout;
+}
+
+
+// One round of om() as a coroutine. Nothing in here blocks: a full inbox or
+// an empty one yields, and the worker steps the other generals meanwhile.
+// Returns true once the round is complete or its deadline passed
+bool omStep(uint8_t id, coroutine_t* co){
+	message_t* getMsg;
+	osStatus_t status;
+	CO_BEGIN(co->resume);
+	co->expected = roundNodes(co->round);
+	co->received = 0;
+	co->wakeAt = osKernelGetTickCount();
+	EvrOmRoundEnter(id, co->round);
+	traceBegin(TRACE_ROUND, id, co->round);
+
+	for (co->node = 0; co->round > 0 && co->node < (aggregateMode ? 1 : roundNodes(co->round-1)); co->node++){
+		co->pending = ((1u << total_generals) - 1) & ~(aggregateMode ? 1u << id : relayPath[id][co->round-1][co->node]);
+		co->shared = aggregateMode ? NULL : relayShared(id, co->round, co->node, co->newMsg, 0);
+		while (co->pending){
+			co->receiver = __builtin_ctz(co->pending);
+			co->pending &= co->pending - 1;
+			co->sendMsg = aggregateMode ? batchFor(id, co->round, co->receiver, &co->copies, 0)
+				: relayFor(id, co->round, co->receiver, co->newMsg, co->shared, &co->copies, 0);
+			// A delaying traitor books its sleep instead of taking it on the
+			// worker, and waits it out here while the worker steps the others
+			co->wakeAt = delayedWake(id, co->wakeAt);
+			while ((int32_t)(co->wakeAt - osKernelGetTickCount()) > 0 && roundTicksLeft(co->round) > 0){
+				drainInbox(id, co->round, &co->received);
+				roomMade(id);
+				CO_YIELD(co->resume);
+			}
+			if (co->sendMsg == NULL){
+				if (co->copies)
+					checkStatus(osErrorResource, co->receiver);
+				continue;
+			}
+			EvrOmRelayPut(id, co->receiver, co->round, co->sendMsg->text);
+			traceFlow('s', id, co->round, traceFlowId(co->round, co->receiver, co->sendMsg->text));
+			for (co->copy = 0; co->copy < co->copies; co->copy++){
+				while ((status = osMessageQueuePut(commandQueue[co->round][co->receiver], &co->sendMsg, MSG_PRIO, 0)) != osOK
+						&& roundTicksLeft(co->round) > 0){
+					drainInbox(id, co->round, &co->received);
+					roomMade(id);
+					// Asks the receiver to wake us, then looks again so that a
+					// get in between is not missed
+					__sync_fetch_and_or(&spaceWanted[co->receiver], 1u << id);
+					if (osMessageQueueGetSpace(commandQueue[co->round][co->receiver]) == 0)
+						CO_YIELD(co->resume);
+				}
+				if (status == osOK){
+					countPut(co->round, id, co->receiver);
+					wakeGeneral(co->receiver);
+				}
+				else {
+					checkStatus(status, co->receiver);
+					msgRelease(co->sendMsg);
+				}
+			}
+		}
+	}
+
+	while (co->received < co->expected){
+		if (osMessageQueueGet(commandQueue[co->round][id], &getMsg, NULL, 0) == osOK){
+			co->received += storeMessage(id, co->round, getMsg);
+			roomMade(id);
+		}
+		else if (roundTicksLeft(co->round) > 0)
+			CO_YIELD(co->resume);
+		else
+			break;
+	}
+	EvrOmRoundExit(id, co->round, co->received);
+	traceEnd(TRACE_ROUND, id, co->round);
+	CO_END(co->resume);
+}
+
+
+// Fills the EIG level of a round from our column of the mailbox matrix
+uint16_t mailboxRead(uint8_t id, uint8_t round){
+	uint16_t received = 0;
+	for (uint8_t sender = 0; sender < total_generals; sender++){
+		uint16_t relays = round > 0 ? roundNodes(round-1) : sender == commanderGeneral;
+		if (sender == id)
+			continue;
+		for (uint16_t k = 0; k < relays; k++){
+			uint16_t slot = mailbox[round%2][sender][id][k];
+			if (slot >> 8 == round+1 && fileRelay(id, round, sender, k, slot & 0xFF))
+				received++;
+		}
+		countReceive(round, id, relays*sizeof(uint16_t));
+	}
+	return received;
+}
+
+
+// Writes our row of the next round with plain stores, one slot for every
+// receiver of every node we relay. A dropped message leaves the slot empty,
+// and so does one a delaying traitor on a worker would write past the
+// deadline of the round before
+void mailboxWrite(uint8_t id, uint8_t round){
+	uint32_t late = 0;
+	for (int node = 0; node < roundNodes(round-1); node++){
+		uint8_t pending = ((1u << total_generals) - 1) & ~relayPath[id][round-1][node];
+		while (pending){
+			uint8_t receiver = __builtin_ctz(pending);
+			char value[MSG_SIZE];
+			pending &= pending - 1;
+			memcpy(value, relayText[id][round-1][node], MSG_SIZE);
+			value[2*(round+1)] = eigGet(id, round-1, node);
+			bool sent = loyalGenerals[id] || traitorSend(id, receiver, round, value);
+			late += loyalGenerals[id] ? 0 : traitorTakeDelay(id);
+			if (sent && (late == 0 || late < roundTicksLeft(round-1)))
+				mailbox[round%2][id][receiver][node] = MAILBOX_SLOT(round, value[2*(round+1)]);
+			else
+				mailbox[round%2][id][receiver][node] = 0;
+		}
+	}
+	countSend(round, id, roundNodes(round-1)*(total_generals-round-1)*sizeof(uint16_t));
+}
+
+
+// One round of the mailbox transport: read what arrived for this round, then
+// write the next round, all before the round's barrier
+void mailboxRound(uint8_t id, uint8_t round){
+	EvrOmRoundEnter(id, round);
+	traceBegin(TRACE_ROUND, id, round);
+	uint16_t received = mailboxRead(id, round);
+	if (round < numTraitors)
+		mailboxWrite(id, round+1);
+	EvrOmRoundExit(id, round, received);
+	traceEnd(TRACE_ROUND, id, round);
+}
+
+
+// om() over the mailbox matrix, with the same barriers as the queue version
+void omMailbox(uint8_t id, uint32_t* generation){
+	for (uint8_t round = 0; round <= numTraitors; round++){
+		mailboxRound(id, round);
+		if (round < numTraitors)
+			roundBarrier(round, generation);
+	}
+	traceBegin(TRACE_RESOLVE, id, numTraitors);
+	decision[id] = resolve(id);
+	traceEnd(TRACE_RESOLVE, id, numTraitors);
+	EvrOmDecision(id, decision[id]);
+	roundBarrier(numTraitors, generation);
+}
+
+
+/**
+ * A worker thread which is created through final.c when the generals run as
+ * coroutines. Worker i steps generals i, i+workers, ... round by round and
+ * meets the barrier once for all of them
+  */
+void worker(void *indexPtr) {
+	uint8_t index = *(uint8_t *)indexPtr;
+	uint32_t generation = 0;
+	schedRegister(index);
+	workerThread[index] = osThreadGetId();
+	while(1){
+		osStatus_t status = barrierWait(&instanceBarrier, &generation, osWaitForever);
+		if (status == osErrorResource){
+			osThreadExit();
+		}
+		for (uint8_t round = 0; round <= numTraitors; round++){
+			bool done = mailboxMode;
+			for (uint8_t id = index; id < total_generals; id += workers){
+				coroutines[id].resume = 0;
+				coroutines[id].round = round;
+				if (mailboxMode && id != commanderGeneral)
+					mailboxRound(id, round);
+			}
+			while (!done){
+				done = true;
+				for (uint8_t id = index; id < total_generals; id += workers){
+					if (id != commanderGeneral && coroutines[id].round == round){
+						if (omStep(id, &coroutines[id]))
+							coroutines[id].round = round+1;
+						else
+							done = false;
+					}
+				}
+				// Everyone is waiting on a queue or a traitor's delay, sleep
+				// until a put or get wakes us or the next wake-up is due
+				if (!done)
+					osThreadFlagsWait(WAKE_FLAG, osFlagsWaitAny, workerTimeout(index, round));
 			}
+			if (round < numTraitors)
+				roundBarrier(round, &generation);
 		}
-			free(doNotSend);
-		}		
+		for (uint8_t id = index; id < total_generals; id += workers){
+			if (id != commanderGeneral){
+				traceBegin(TRACE_RESOLVE, id, numTraitors);
+				decision[id] = resolve(id);
+				traceEnd(TRACE_RESOLVE, id, numTraitors);
+				EvrOmDecision(id, decision[id]);
+			}
+		}
+		roundBarrier(numTraitors, &generation);
 	}
-	
-	
-/** 
+}
+
+
+/**
  * A general node which is created through final.c
   */
 void general(void *idPtr) {
-	osSemaphoreAcquire(barrierSem, osWaitForever);
 	uint8_t id = *(uint8_t *)idPtr;
-	// Superloop
+	uint32_t generation = 0;
+	schedRegister(id);
+	// Superloop, one OM instance per pass of the start barrier
 	while(1){
-		char msg[4];
-		osStatus_t status = osMessageQueueGet(commandQueue[0][id], &msg, NULL, osWaitForever);
-		if (status == osOK){
-			om(msg, id, numTraitors);
-			// Release semaphore to signal being done OM
-			osSemaphoreRelease(finishedSem);
+		osStatus_t status = barrierWait(&instanceBarrier, &generation, osWaitForever);
+		if (status == osErrorResource){
+			osThreadExit();
+		}
+		if (vectorMode){
+			omVector(id, &generation);
+		}
+		else if (randomMode){
+			omRandom(id, &generation);
+		}
+		else if (pbftMode){
+			omPbft(id, &generation);
+		}
+		else if (id != commanderGeneral && mailboxMode){
+			omMailbox(id, &generation);
+		}
+		else if (id != commanderGeneral){
+			om(id, &generation);
 		}
 		else{
-			osMutexAcquire(printMutex, osWaitForever);
-			printf("Error on init pull id: %i\n", id);
-			osMutexRelease(printMutex);
+			// The commander's value went out with broadcast(), only keep pace
+			for (uint8_t round = 0; round <= lastRound(); round++)
+				roundBarrier(round, &generation);
 		}
 	}
 }
@@ -2,11 +2,11 @@
 #define GENERAL_H
 
 #include <stdbool.h>
-#include <stdio.h>
+#include "fmt.h"
 #include <stdint.h>
 
 #define c_assert(e) ((e) ? (true) : \
-        (printf("%s,%d: assertion '%s' failed\n", \
+        (fmtPrintf("%s,%d: assertion '%s' failed\n", \
         __FILE__, __LINE__, #e), false))
 
 #define ATTACK 'A'
@@ -15,6 +15,27 @@
 bool setup(uint8_t nGeneral, bool loyal[], uint8_t reporter);
 void cleanup(void);
 void broadcast(char command, uint8_t commander);
+void broadcastAll(const char* commands);
+void setRoundTimeout(uint32_t ticks);
+void setWorkers(uint8_t threads);
+void setMailbox(bool enable);
+void setAggregate(bool enable);
+void setVerbose(bool enable);
+void setInteractive(bool enable);
+void setRandomized(bool enable);
+void setPbft(bool enable);
+void setDigest(bool enable);
+void setCodecCheck(bool enable);
+void broadcastPayload(const uint8_t* data, uint16_t length, uint8_t commander);
+uint32_t getDigest(uint8_t id);
+uint8_t getView(uint8_t id);
+uint8_t getCoinRounds(uint8_t id);
+bool omTraffic(void);
+char getDecision(uint8_t id);
+char getVector(uint8_t id, uint8_t commander);
+void reportBarrier(void);
+uint32_t generalStackSize(void);
 void general(void *args);
+void worker(void *args);
 
 #endif
@@ -0,0 +1,90 @@
+#include "LPC17xx.h"
+#include "itm.h"
+
+#include <stdarg.h>
+#include "fmt.h"
+
+#define MAX_GENERALS 7
+#define ITM_UNLOCK 0xC5ACCE55
+
+// Bytes each port lost to a full FIFO. A port has one writer, the general
+// it belongs to, so the count needs no lock
+uint32_t itmDrops[ITM_PORTS];
+
+
+/**
+ * Enables the console port and one port per general. Only takes effect once
+ * the debugger has switched the ITM on for SWO, and must run privileged,
+ * before the kernel starts
+  */
+void itmInit(void){
+	if ((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0)
+		return;
+	ITM->LAR = ITM_UNLOCK;
+	ITM->TER |= (1UL << ITM_GENERAL(MAX_GENERALS)) - 1;
+}
+
+
+bool itmEnabled(uint8_t port){
+	return port < ITM_PORTS && (ITM->TCR & ITM_TCR_ITMENA_Msk) != 0 && (ITM->TER & (1UL << port)) != 0;
+}
+
+
+/**
+ * Writes text to a stimulus port a word at a time, the last one to three
+ * bytes as a halfword and a byte. Reading a port returns 0 while its FIFO is
+ * full, and then the rest of the text is dropped rather than waited for, so
+ * it runs into the port's next line. Returns the bytes written
+  */
+uint32_t itmWrite(uint8_t port, const char *text, uint32_t length){
+	const uint8_t *byte = (const uint8_t *)text;
+	uint32_t written = 0;
+
+	if (!itmEnabled(port))
+		return 0;
+	while (length - written >= 4){
+		if (ITM->PORT[port].u32 == 0)
+			break;
+		ITM->PORT[port].u32 = byte[written] | byte[written+1] << 8 | byte[written+2] << 16 | (uint32_t)byte[written+3] << 24;
+		written += 4;
+	}
+	if (length - written >= 2 && length - written < 4 && ITM->PORT[port].u32 != 0){
+		ITM->PORT[port].u16 = byte[written] | byte[written+1] << 8;
+		written += 2;
+	}
+	if (length - written == 1 && ITM->PORT[port].u32 != 0){
+		ITM->PORT[port].u8 = byte[written];
+		written++;
+	}
+	itmDrops[port] += length - written;
+	return written;
+}
+
+
+// Formats a line on the caller's stack and writes it to port
+int itmPrintf(uint8_t port, const char *format, ...){
+	char line[ITM_LINE];
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = fmtFormat(line, sizeof(line), format, args);
+	va_end(args);
+	return itmWrite(port, line, length);
+}
+
+
+uint32_t itmDropped(uint8_t port){
+	return port < ITM_PORTS ? itmDrops[port] : 0;
+}
+
+
+// Prints the ports of n generals that lost output, since the counts
+// were last reported
+void reportItm(uint8_t n){
+	for (uint8_t id = 0; id < n && id < MAX_GENERALS; id++){
+		if (itmDrops[ITM_GENERAL(id)])
+			fmtPrintf("id: %u, itm dropped: %u bytes\n", id, itmDrops[ITM_GENERAL(id)]);
+		itmDrops[ITM_GENERAL(id)] = 0;
+	}
+}
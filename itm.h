@@ -0,0 +1,24 @@
+#ifndef ITM_H
+#define ITM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Stimulus ports: 0 stays the printf console, general id gets ITM_GENERAL(id)
+// for its fmtPrintf() lines and status. util/itm.py splits an SWO capture
+// back into one stream per port
+#define ITM_CONSOLE 0
+#define ITM_GENERAL(id) (1 + (id))
+#define ITM_PORTS 32
+
+// Longest line itmPrintf formats, the rest is cut
+#define ITM_LINE 64
+
+void itmInit(void);
+bool itmEnabled(uint8_t port);
+uint32_t itmWrite(uint8_t port, const char *text, uint32_t length);
+int itmPrintf(uint8_t port, const char *format, ...);
+uint32_t itmDropped(uint8_t port);
+void reportItm(uint8_t n);
+
+#endif
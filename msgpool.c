@@ -0,0 +1,45 @@
+#include "msgpool.h"
+
+#include <string.h>
+
+osMemoryPoolId_t messagePool;
+uint32_t messageText;
+
+
+/**
+ * Creates the arena for one test: count blocks, each with room for a
+ * message of textSize characters including the terminator
+  */
+bool poolInit(uint32_t count, uint32_t textSize){
+	messageText = textSize;
+	messagePool = osMemoryPoolNew(count, sizeof(message_t) + textSize, NULL);
+	return messagePool != NULL;
+}
+
+
+void poolDelete(void){
+	osMemoryPoolDelete(messagePool);
+	messagePool = NULL;
+}
+
+
+/**
+ * Copies text into a new block that is freed after refs releases. Returns
+ * NULL if the pool stayed empty for timeout ticks
+  */
+message_t *msgAlloc(const char *text, uint8_t refs, uint32_t timeout){
+	message_t *msg = osMemoryPoolAlloc(messagePool, timeout);
+	if (msg == NULL)
+		return NULL;
+	msg->refs = refs;
+	strncpy(msg->text, text, messageText-1);
+	msg->text[messageText-1] = '\0';
+	return msg;
+}
+
+
+// Drops one reference, the last one returns the block to the pool
+void msgRelease(message_t *msg){
+	if (__sync_sub_and_fetch(&msg->refs, 1) == 0)
+		osMemoryPoolFree(messagePool, msg);
+}
@@ -0,0 +1,20 @@
+#ifndef MSGPOOL_H
+#define MSGPOOL_H
+
+#include <cmsis_os2.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A message lives in one pool block and is written once. Queues only carry
+// the pointer to it, and every recipient holds one reference
+typedef struct {
+	volatile uint8_t refs;
+	char text[];
+} message_t;
+
+bool poolInit(uint32_t count, uint32_t textSize);
+void poolDelete(void);
+message_t *msgAlloc(const char *text, uint8_t refs, uint32_t timeout);
+void msgRelease(message_t *msg);
+
+#endif
@@ -0,0 +1,92 @@
+#include "payload.h"
+
+#include <string.h>
+
+#define MAX_GENERALS 7
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+// What every general holds of the current command. Only general id writes
+// payloads[id], others read it once it is valid to fetch from it
+payload_t payloads[MAX_GENERALS];
+uint32_t moved[MAX_GENERALS];
+
+
+/**
+ * Forgets every payload and the bytes moved, before an instance
+  */
+void payloadReset(void){
+	for (int i = 0; i < MAX_GENERALS; i++){
+		payloads[i].valid = false;
+		payloads[i].length = 0;
+		moved[i] = 0;
+	}
+}
+
+
+// FNV-1a, which is what goes through OM instead of the payload. It only
+// tells payloads apart, it does not stand up to a forger
+uint32_t payloadDigest(const uint8_t *data, uint16_t length){
+	uint32_t h = FNV_OFFSET;
+	for (uint16_t i = 0; i < length; i++){
+		h ^= data[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+
+/**
+ * Gives general id a payload of its own, the commander's command
+  */
+bool payloadStore(uint8_t id, const uint8_t *data, uint16_t length){
+	if (id >= MAX_GENERALS || length > PAYLOAD_MAX)
+		return false;
+	memcpy(payloads[id].data, data, length);
+	payloads[id].length = length;
+	payloads[id].digest = payloadDigest(data, length);
+	payloads[id].valid = true;
+	return true;
+}
+
+
+/**
+ * Copies the payload server holds into general id's and keeps it if it
+ * matches the agreed digest. corrupt is a traitor serving it with a byte
+ * flipped. The bytes count as moved either way
+  */
+bool payloadFetch(uint8_t id, uint8_t server, uint32_t digest, bool corrupt){
+	if (id >= MAX_GENERALS || server >= MAX_GENERALS || !payloads[server].valid)
+		return false;
+	payload_t *own = &payloads[id];
+	const payload_t *from = &payloads[server];
+	// Nobody fetches from us while the copy is half written
+	own->valid = false;
+	memcpy(own->data, from->data, from->length);
+	own->length = from->length;
+	if (corrupt && own->length > 0)
+		own->data[own->length-1] ^= 0xFF;
+	moved[id] += own->length;
+	own->digest = payloadDigest(own->data, own->length);
+	own->valid = own->digest == digest;
+	return own->valid;
+}
+
+
+bool payloadHas(uint8_t id, uint32_t digest){
+	return id < MAX_GENERALS && payloads[id].valid && payloads[id].digest == digest;
+}
+
+
+const payload_t *payloadGet(uint8_t id){
+	return id < MAX_GENERALS ? &payloads[id] : NULL;
+}
+
+
+// Payload bytes copied between generals since the last reset
+uint32_t payloadMoved(void){
+	uint32_t total = 0;
+	for (int i = 0; i < MAX_GENERALS; i++)
+		total += moved[i];
+	return total;
+}
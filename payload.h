@@ -0,0 +1,27 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Largest command payload a general can hold
+#ifndef PAYLOAD_MAX
+#define PAYLOAD_MAX 1024
+#endif
+
+typedef struct {
+	uint16_t length;
+	bool valid;
+	uint32_t digest;
+	uint8_t data[PAYLOAD_MAX];
+} payload_t;
+
+void payloadReset(void);
+uint32_t payloadDigest(const uint8_t *data, uint16_t length);
+bool payloadStore(uint8_t id, const uint8_t *data, uint16_t length);
+bool payloadFetch(uint8_t id, uint8_t server, uint32_t digest, bool corrupt);
+bool payloadHas(uint8_t id, uint32_t digest);
+const payload_t *payloadGet(uint8_t id);
+uint32_t payloadMoved(void);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdint.h>
+
+// A corpus is a header and then records, laid out exactly as below in
+// little-endian, so the runner reads them in place from flash. corpus.s
+// links scenarios.bin, and util/scenarios.py writes and reads these files
+#define SCENARIO_MAGIC "OMSC"
+#define SCENARIO_VERSION 1
+
+// Only agreement among the loyal lieutenants is checked, not expected.
+// What a traitor commander makes them agree on depends on its strategy
+#define SCENARIO_AGREE 0x01
+
+typedef struct {
+	char magic[4];
+	uint8_t version;
+	uint8_t recordSize;
+	uint16_t reserved;
+} scenario_header_t;
+
+// One OM instance. Bit i of a mask stands for general i
+typedef struct {
+	uint8_t n;
+	uint8_t loyal;
+	uint8_t reporter;
+	uint8_t commander;
+	char command;
+	uint8_t strategy;	// of every traitor
+	uint8_t expected;	// loyal lieutenants that must decide ATTACK, the rest RETREAT
+	uint8_t flags;
+} scenario_t;
+
+typedef enum {
+	SCENARIO_PASS,
+	SCENARIO_WRONG,
+	SCENARIO_SETUP_FAILED,
+	SCENARIO_BAD_RECORD
+} scenario_status_t;
+
+// Written for every record that did not pass
+typedef struct {
+	uint32_t index;
+	uint8_t decided;	// generals that decided ATTACK
+	uint8_t wrong;		// loyal lieutenants that broke the expectation
+	uint8_t status;
+	uint8_t reserved;
+} scenario_result_t;
+
+// Linked in by corpus.s
+extern const scenario_header_t scenarioCorpus;
+extern const uint32_t scenarioCorpusSize;
+
+#endif
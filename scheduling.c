@@ -0,0 +1,124 @@
+#include <cmsis_os2.h>
+#include <rtx_os.h>
+#include "scheduling.h"
+
+#include "fmt.h"
+#include <string.h>
+
+#define MAX_GENERALS 7
+
+osThreadId_t schedThreads[MAX_GENERALS];
+sched_stats_t schedCounters[MAX_GENERALS];
+uint32_t blockedSince[MAX_GENERALS];
+bool cooperativeMode;
+uint32_t robinTimeout;
+
+
+// Runs inside the kernel, so only a short scan and no RTOS calls that block
+static int lookup(osThreadId_t thread){
+	for (int i = 0; i < MAX_GENERALS; i++){
+		if (schedThreads[i] == thread)
+			return i;
+	}
+	return -1;
+}
+
+
+/*
+ * RTX thread hooks. The kernel calls these Event Recorder functions on every
+ * switch, preemption and block/unblock; the library versions are weak, so
+ * defining them here routes the events into our counters
+  */
+void EvrRtxThreadSwitched(osThreadId_t thread_id){
+	int i = lookup(thread_id);
+	if (i >= 0)
+		schedCounters[i].switches++;
+}
+
+
+void EvrRtxThreadPreempted(osThreadId_t thread_id){
+	int i = lookup(thread_id);
+	if (i >= 0)
+		schedCounters[i].preemptions++;
+}
+
+
+void EvrRtxThreadBlocked(osThreadId_t thread_id, uint32_t timeout){
+	int i = lookup(thread_id);
+	if (i >= 0){
+		schedCounters[i].blocks++;
+		blockedSince[i] = osKernelGetSysTimerCount();
+	}
+}
+
+
+void EvrRtxThreadUnblocked(osThreadId_t thread_id, uint32_t ret_val){
+	int i = lookup(thread_id);
+	if (i >= 0)
+		schedCounters[i].blockedTime += osKernelGetSysTimerCount() - blockedSince[i];
+}
+
+
+/**
+ * Forgets all registered generals and zeroes their counters
+  */
+void schedReset(void){
+	memset(schedThreads, 0, sizeof(schedThreads));
+	memset(schedCounters, 0, sizeof(schedCounters));
+}
+
+
+/**
+ * Called by a general's own thread so its kernel events are counted
+  */
+void schedRegister(uint8_t id){
+	if (id < MAX_GENERALS)
+		schedThreads[id] = osThreadGetId();
+}
+
+
+/**
+ * In cooperative mode round-robin is switched off, so a general is only
+ * switched out when it blocks or reaches a round boundary
+  */
+void setCooperative(bool cooperative){
+	if (cooperative && !cooperativeMode){
+		robinTimeout = osRtxInfo.thread.robin.timeout;
+		osRtxInfo.thread.robin.timeout = 0;
+	}
+	else if (!cooperative && cooperativeMode){
+		osRtxInfo.thread.robin.timeout = robinTimeout;
+	}
+	cooperativeMode = cooperative;
+}
+
+
+void schedRoundBoundary(void){
+	if (cooperativeMode)
+		osThreadYield();
+}
+
+
+/**
+ * Index the calling thread registered under, -1 for any other thread
+  */
+int schedIndex(void){
+	return lookup(osThreadGetId());
+}
+
+
+const sched_stats_t *schedStats(uint8_t id){
+	return id < MAX_GENERALS ? &schedCounters[id] : NULL;
+}
+
+
+/**
+ * Prints the scheduling counters of every general of the last test
+  */
+void reportSched(uint8_t nGeneral){
+	for (uint8_t i = 0; i < nGeneral && i < MAX_GENERALS; i++){
+		sched_stats_t *stats = &schedCounters[i];
+		fmtPrintf("id: %i, switches: %u, preempted: %u, blocked: %u times %u cycles\n",
+			i, stats->switches, stats->preemptions, stats->blocks, stats->blockedTime);
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef SCHEDULING_H
+#define SCHEDULING_H
+
+#include <cmsis_os2.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Scheduling counters of one general, times in kernel system timer counts
+typedef struct {
+	uint32_t switches;
+	uint32_t preemptions;
+	uint32_t blocks;
+	uint32_t blockedTime;
+} sched_stats_t;
+
+void schedReset(void);
+void schedRegister(uint8_t id);
+void setCooperative(bool cooperative);
+void schedRoundBoundary(void);
+int schedIndex(void);
+const sched_stats_t *schedStats(uint8_t id);
+void reportSched(uint8_t nGeneral);
+
+#endif
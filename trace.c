@@ -0,0 +1,168 @@
+#include <cmsis_os2.h>
+#include "trace.h"
+#include "scheduling.h"
+
+#include "fmt.h"
+#include <string.h>
+
+#define MAX_GENERALS 7
+// One ring per registered thread plus one for every other thread, which in
+// practice is the one running broadcast()
+#define TRACE_THREADS (MAX_GENERALS+1)
+// Spans a dump tracks as open at once per ring, a worker has a round and a
+// queue wait open for each of its generals
+#define TRACE_OPEN (2*MAX_GENERALS+2)
+
+typedef struct {
+	uint32_t next;
+	trace_record_t records[TRACE_RECORDS];
+} trace_ring_t;
+
+trace_ring_t rings[TRACE_THREADS];
+bool tracing;
+
+static const char *kindNames[N_TRACE_KINDS] = {
+	"round", "queue wait", "barrier wait", "resolve", "relay"
+};
+
+
+/**
+ * Switches recording on or off, off costs one test per trace point
+  */
+void traceEnable(bool enable){
+	tracing = enable;
+}
+
+
+void traceReset(void){
+	memset(rings, 0, sizeof(rings));
+}
+
+
+// Every ring has a single writer, the thread it belongs to, so appending
+// needs no lock
+static void record(trace_kind_t kind, char phase, uint8_t general, uint8_t round, uint32_t flow){
+	int thread = schedIndex();
+	trace_ring_t *ring = &rings[thread < 0 ? MAX_GENERALS : thread];
+	trace_record_t *rec = &ring->records[ring->next % TRACE_RECORDS];
+	rec->time = osKernelGetSysTimerCount();
+	rec->flow = flow;
+	rec->kind = kind;
+	rec->general = general;
+	rec->round = round;
+	rec->phase = phase;
+	ring->next++;
+}
+
+
+void traceBegin(trace_kind_t kind, uint8_t general, uint8_t round){
+	if (tracing)
+		record(kind, 'B', general, round, 0);
+}
+
+
+void traceEnd(trace_kind_t kind, uint8_t general, uint8_t round){
+	if (tracing)
+		record(kind, 'E', general, round, 0);
+}
+
+
+/**
+ * Identifies a relayed message by round, receiver and the digits of its
+ * path, so the put and the get of the same message carry the same id
+  */
+uint32_t traceFlowId(uint8_t round, uint8_t receiver, const char *msg){
+	uint32_t flow = ((uint32_t)round << 28) | ((uint32_t)receiver << 24);
+	while (msg[0] >= '0' && msg[0] <= '9' && msg[1] == ':'){
+		flow = (flow & 0xFF000000u) | ((flow << 4) & 0x00FFFFFFu) | (msg[0] - '0');
+		msg += 2;
+	}
+	return flow;
+}
+
+
+void traceFlow(char phase, uint8_t general, uint8_t round, uint32_t flow){
+	if (tracing)
+		record(TRACE_RELAY, phase, general, round, flow);
+}
+
+
+// Records of a ring oldest first, skipping any the ring already overwrote
+static uint32_t first(const trace_ring_t *ring){
+	return ring->next > TRACE_RECORDS ? ring->next - TRACE_RECORDS : 0;
+}
+
+
+// Whether a span record goes into the dump. An 'E' is left out when its 'B'
+// was overwritten, and so is a 'B' beyond TRACE_OPEN with its 'E', as the
+// viewers draw an unmatched end as a broken span. open holds the spans
+// begun and not yet ended, matched by kind, general and round
+static bool balanced(const trace_record_t *rec, const trace_record_t **open, uint8_t *opened){
+	if (rec->phase == 'B'){
+		if (*opened == TRACE_OPEN)
+			return false;
+		open[(*opened)++] = rec;
+		return true;
+	}
+	for (int i = *opened - 1; i >= 0; i--){
+		if (open[i]->kind == rec->kind && open[i]->general == rec->general && open[i]->round == rec->round){
+			open[i] = open[--(*opened)];
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+ * Prints every ring as Chrome trace event JSON, which chrome://tracing and
+ * ui.perfetto.dev open directly. Each thread is a track, spans are named by
+ * kind, and relayed messages are flow arrows. Nothing when tracing is off
+  */
+void traceDump(void){
+	uint32_t start = 0;
+	uint32_t perUs = osKernelGetSysTimerFreq() / 1000000;
+	bool found = false;
+	bool comma = false;
+	if (!tracing)
+		return;
+	if (perUs == 0)
+		perUs = 1;
+	// Times are relative to the oldest record left in any ring
+	for (int thread = 0; thread < TRACE_THREADS; thread++){
+		if (rings[thread].next == 0)
+			continue;
+		uint32_t time = rings[thread].records[first(&rings[thread]) % TRACE_RECORDS].time;
+		if (!found || (int32_t)(time - start) < 0)
+			start = time;
+		found = true;
+	}
+
+	fmtPrintf("{\"traceEvents\":[\n");
+	for (int thread = 0; thread < TRACE_THREADS; thread++){
+		const trace_ring_t *ring = &rings[thread];
+		const trace_record_t *open[TRACE_OPEN];
+		uint8_t opened = 0;
+		if (ring->next == 0)
+			continue;
+		fmtPrintf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+			comma ? ",\n" : "", thread, thread < MAX_GENERALS ? "thread" : "broadcast", thread);
+		comma = true;
+		for (uint32_t i = first(ring); i < ring->next; i++){
+			const trace_record_t *rec = &ring->records[i % TRACE_RECORDS];
+			uint32_t us = (rec->time - start) / perUs;
+			if ((rec->phase == 'B' || rec->phase == 'E') && !balanced(rec, open, &opened))
+				continue;
+			if ((rec->phase == 'B' || rec->phase == 'E') && rec->general == TRACE_NO_GENERAL)
+				fmtPrintf(",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":0,\"tid\":%d,\"args\":{\"round\":%u}}",
+					kindNames[rec->kind], rec->phase, us, thread, rec->round);
+			else if (rec->phase == 'B' || rec->phase == 'E')
+				fmtPrintf(",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":0,\"tid\":%d,\"args\":{\"general\":%u,\"round\":%u}}",
+					kindNames[rec->kind], rec->phase, us, thread, rec->general, rec->round);
+			else
+				fmtPrintf(",\n{\"name\":\"%s\",\"cat\":\"relay\",\"ph\":\"%c\",\"bp\":\"e\",\"id\":%u,\"ts\":%u,\"pid\":0,\"tid\":%d}",
+					kindNames[rec->kind], rec->phase, rec->flow, us, thread);
+		}
+	}
+	fmtPrintf("\n]}\n");
+}
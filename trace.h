@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Records kept per thread, the oldest are overwritten first
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 64
+#endif
+
+// Spans of a thread rather than of one general, like barrier waits
+#define TRACE_NO_GENERAL 0xFF
+
+typedef enum {
+	TRACE_ROUND,
+	TRACE_QUEUE_WAIT,
+	TRACE_BARRIER_WAIT,
+	TRACE_RESOLVE,
+	TRACE_RELAY,
+	N_TRACE_KINDS
+} trace_kind_t;
+
+// One fixed-size record. phase is the Chrome trace phase: 'B' and 'E' open
+// and close a span, 's' and 'f' start and finish the flow of a message
+typedef struct {
+	uint32_t time;
+	uint32_t flow;
+	uint8_t kind;
+	uint8_t general;
+	uint8_t round;
+	char phase;
+} trace_record_t;
+
+void traceEnable(bool enable);
+void traceReset(void);
+void traceBegin(trace_kind_t kind, uint8_t general, uint8_t round);
+void traceEnd(trace_kind_t kind, uint8_t general, uint8_t round);
+uint32_t traceFlowId(uint8_t round, uint8_t receiver, const char *msg);
+void traceFlow(char phase, uint8_t general, uint8_t round, uint32_t flow);
+void traceDump(void);
+
+#endif
@@ -0,0 +1,188 @@
+#include <cmsis_os2.h>
+#include "traitor.h"
+#include "general.h"
+
+#include <string.h>
+
+#define MAX_GENERALS 7
+#define DEFAULT_DELAY 10
+#define DEFAULT_FLOOD 2
+
+typedef uint8_t (*strategy_fn)(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value);
+
+typedef struct {
+	strategy_t strategy;
+	uint32_t param;
+} traitor_t;
+
+traitor_t traitors[MAX_GENERALS];
+uint32_t traitorSeed;
+uint8_t traitorReporter;
+// Generals whose delays are booked in owed instead of slept
+uint8_t deferredDelays;
+uint32_t owed[MAX_GENERALS];
+
+
+static char opposite(char value){
+	return value == ATTACK ? RETREAT : ATTACK;
+}
+
+
+static char byParity(uint8_t n){
+	return n % 2 == 0 ? RETREAT : ATTACK;
+}
+
+
+// Stateless mixer so that a decision only depends on the seed and the message,
+// never on which thread happens to be simulating the traitor
+static uint32_t mix(uint32_t h){
+	h ^= h >> 16;
+	h *= 0x7feb352dU;
+	h ^= h >> 15;
+	h *= 0x846ca68bU;
+	h ^= h >> 16;
+	return h;
+}
+
+
+static uint8_t parityStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	*value = byParity(round == 0 ? receiver : id);
+	return 1;
+}
+
+
+static uint8_t randomStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	// The path is part of the key so each relay gets its own coin
+	uint32_t h = traitorSeed ^ ((uint32_t)id << 8) ^ ((uint32_t)receiver << 16) ^ ((uint32_t)round << 24);
+	for (; *msg; msg++)
+		h = mix(h ^ (uint8_t)*msg);
+	h = mix(h);
+	*value = (h & 1) ? ATTACK : RETREAT;
+	return 1;
+}
+
+
+static uint8_t equivocateStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	*value = byParity(receiver);
+	return 1;
+}
+
+
+static uint8_t targetReporterStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	if (receiver == traitorReporter)
+		*value = opposite(*value);
+	return 1;
+}
+
+
+static uint8_t silentStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	return 0;
+}
+
+
+static uint8_t delayStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	if (deferredDelays & (1u << id))
+		owed[id] += traitors[id].param;
+	else
+		osDelay(traitors[id].param);
+	return 1;
+}
+
+
+static uint8_t floodStrategy(uint8_t id, uint8_t receiver, uint8_t round, const char *msg, char *value){
+	*value = opposite(*value);
+	return (uint8_t)traitors[id].param;
+}
+
+
+static const strategy_fn strategyTable[N_STRATEGIES] = {
+	parityStrategy,
+	randomStrategy,
+	equivocateStrategy,
+	targetReporterStrategy,
+	silentStrategy,
+	delayStrategy,
+	floodStrategy
+};
+
+static const char *strategyNames[N_STRATEGIES] = {
+	"parity", "random", "equivocate", "target-reporter", "silent", "delay", "flood"
+};
+
+
+/**
+ * Puts every general back on the original parity behaviour
+  */
+void traitorReset(uint8_t reporter){
+	traitorReporter = reporter;
+	for (int i = 0; i < MAX_GENERALS; i++){
+		traitors[i].strategy = TRAITOR_PARITY;
+		traitors[i].param = 0;
+	}
+}
+
+
+void seedTraitors(uint32_t seed){
+	traitorSeed = seed;
+}
+
+
+/**
+ * Selects the behaviour of general id when it is a traitor. param is the delay
+ * in ticks for TRAITOR_DELAY and the copy count for TRAITOR_FLOOD (0 = default)
+  */
+void setTraitorStrategy(uint8_t id, strategy_t strategy, uint32_t param){
+	if (id >= MAX_GENERALS || strategy >= N_STRATEGIES)
+		return;
+	if (param == 0){
+		if (strategy == TRAITOR_DELAY)
+			param = DEFAULT_DELAY;
+		else if (strategy == TRAITOR_FLOOD)
+			param = DEFAULT_FLOOD;
+	}
+	traitors[id].strategy = strategy;
+	traitors[id].param = param;
+}
+
+
+/**
+ * Makes TRAITOR_DELAY book its sleeps for the generals in mask instead of
+ * taking them, for generals that share a thread. traitorTakeDelay() hands
+ * them over to be waited out without blocking the others
+  */
+void traitorDeferDelays(uint8_t mask){
+	deferredDelays = mask;
+	memset(owed, 0, sizeof(owed));
+}
+
+
+// Ticks general id owes since the last call, 0 unless deferred
+uint32_t traitorTakeDelay(uint8_t id){
+	uint32_t delay = owed[id];
+	owed[id] = 0;
+	return delay;
+}
+
+
+strategy_t getTraitorStrategy(uint8_t id){
+	return id < MAX_GENERALS ? traitors[id].strategy : TRAITOR_PARITY;
+}
+
+
+const char *strategyName(strategy_t strategy){
+	return strategy < N_STRATEGIES ? strategyNames[strategy] : "?";
+}
+
+
+/**
+ * Rewrites the value at the end of msg the way traitor id would for receiver.
+ * round is 0 for the commander's broadcast. Returns how many copies to send,
+ * 0 meaning the message is dropped
+  */
+uint8_t traitorSend(uint8_t id, uint8_t receiver, uint8_t round, char *msg){
+	size_t len = strlen(msg);
+	char value = msg[len-1];
+	uint8_t copies = strategyTable[traitors[id].strategy](id, receiver, round, msg, &value);
+	msg[len-1] = value;
+	return copies;
+}
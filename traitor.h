@@ -0,0 +1,28 @@
+#ifndef TRAITOR_H
+#define TRAITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Behaviours a traitor can be given; PARITY is the original hard-coded one
+typedef enum {
+	TRAITOR_PARITY,          // commander lies by receiver parity, relays by own id parity
+	TRAITOR_RANDOM,          // coin flip per (traitor, receiver, path), reproducible from the seed
+	TRAITOR_EQUIVOCATE,      // ATTACK to odd receivers, RETREAT to even ones, every round
+	TRAITOR_TARGET_REPORTER, // honest to everyone except the reporter, who gets the opposite
+	TRAITOR_SILENT,          // never sends anything
+	TRAITOR_DELAY,           // honest value, but only after param ticks
+	TRAITOR_FLOOD,           // opposite value, sent param times to each receiver
+	N_STRATEGIES
+} strategy_t;
+
+void traitorReset(uint8_t reporter);
+void seedTraitors(uint32_t seed);
+void setTraitorStrategy(uint8_t id, strategy_t strategy, uint32_t param);
+strategy_t getTraitorStrategy(uint8_t id);
+void traitorDeferDelays(uint8_t mask);
+uint32_t traitorTakeDelay(uint8_t id);
+const char *strategyName(strategy_t strategy);
+uint8_t traitorSend(uint8_t id, uint8_t receiver, uint8_t round, char *msg);
+
+#endif
@@ -24,7 +24,9 @@
 #ifdef __RTGT_UART 
 	#include "uart.h"
 	#define PORT_NUM 0
-	#define BAUD_RATE 9600
+	#ifndef BAUD_RATE
+		#define BAUD_RATE 115200	//Up to 1000000, UART0 runs from CCLK (PCLKSEL0_Val)
+	#endif
 #endif
 
 #if !defined( __RTGT_GLCD ) && !defined(__RTGT_UART)
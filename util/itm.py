@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Splits an SWO capture into the output of each ITM stimulus port.
+
+Port 0 is the printf console and port 1 + id belongs to general id (itm.h).
+The capture is the raw SWO byte stream, as saved by the debug probe's SWO
+viewer or by OpenOCD's tpiu with a file as output. Packets from hardware
+sources and timestamps are skipped.
+
+    python3 itm.py swo.bin [--port N]
+    python3 itm.py --selftest
+"""
+
+import argparse
+import sys
+from collections import defaultdict
+
+
+def packets(data):
+    """Yields (port, payload) for each software source packet, and
+    (None, None) for each overflow packet"""
+    i = 0
+    while i < len(data):
+        header = data[i]
+        i += 1
+        if header == 0x00 or header == 0x80:
+            # Synchronisation: zeros closed by 0x80
+            continue
+        if header == 0x70:
+            yield None, None
+        elif header & 0x03:
+            size = (1, 2, 4)[(header & 0x03) - 1]
+            payload = data[i:i + size]
+            i += size
+            if not header & 0x04:
+                yield header >> 3, payload
+        elif header & 0x80:
+            # Local or global timestamp, or extension: continuation bytes
+            while i < len(data) and data[i] & 0x80:
+                i += 1
+            i += 1
+
+
+def label(port):
+    return 'console' if port == 0 else 'id %d' % (port - 1)
+
+
+def demux(data, only=None):
+    """The lines of every port, or of port only, in the order they were
+    finished, and the number of overflow packets. A line still open at the
+    end of the capture comes last"""
+    # Each port's text is cut into lines as it arrives, so the lines
+    # of different ports keep the order they were finished in
+    pending = defaultdict(bytearray)
+    lines = []
+    overflows = 0
+    for port, payload in packets(data):
+        if port is None:
+            overflows += 1
+            continue
+        if only is not None and port != only:
+            continue
+        pending[port] += payload
+        while b'\n' in pending[port]:
+            line, _, rest = bytes(pending[port]).partition(b'\n')
+            pending[port] = bytearray(rest)
+            lines.append((port, line.decode('latin-1').rstrip('\r')))
+    for port, rest in sorted(pending.items()):
+        if rest:
+            lines.append((port, rest.decode('latin-1')))
+    return lines, overflows
+
+
+def stimulus(port, text):
+    """The packets itmWrite() sends for text: words, then a halfword and a
+    byte for what is left"""
+    data = text.encode('latin-1')
+    out = bytearray()
+    at = 0
+    while len(data) - at >= 4:
+        out += bytes([port << 3 | 3]) + data[at:at + 4]
+        at += 4
+    if len(data) - at >= 2:
+        out += bytes([port << 3 | 2]) + data[at:at + 2]
+        at += 2
+    if len(data) - at == 1:
+        out += bytes([port << 3 | 1]) + data[at:at + 1]
+    return bytes(out)
+
+
+def selftest():
+    """Demultiplexes a synthetic capture with interleaved generals,
+    timestamps, hardware packets and an overflow"""
+    swo = bytearray(b'\x00\x00\x00\x00\x00\x80')
+    swo += stimulus(0, 'test case 0\n')
+    swo += stimulus(1, 'OVF 0')
+    swo += stimulus(2, 'id: 1, decided A\n')
+    swo += b'\xc0\x81\x02'
+    swo += b'\x30'
+    swo += stimulus(1, '\n')
+    swo += bytes([5 << 3 | 4 | 2]) + b'\x12\x34'
+    swo += b'\x70'
+    swo += stimulus(3, 'id: 2, decided A\r\n')
+    swo += stimulus(0, 'done')
+    expected = [(0, 'test case 0'), (2, 'id: 1, decided A'), (1, 'OVF 0'),
+                (3, 'id: 2, decided A'), (0, 'done')]
+    failed = 0
+    checks = [(demux(bytes(swo)), (expected, 1)),
+              (demux(bytes(swo), 2), ([(2, 'id: 1, decided A')], 1)),
+              (demux(stimulus(4, 'abcdefg\n')), ([(4, 'abcdefg')], 0))]
+    for got, want in checks:
+        if got != want:
+            print('got %r, expected %r' % (got, want))
+            failed += 1
+    print('itm: %d checks failed' % failed)
+    return failed == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', nargs='?')
+    parser.add_argument('--port', type=int, help='print only this port, without labels')
+    parser.add_argument('--selftest', action='store_true', help='decode a synthetic capture and check the result')
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest() else 1)
+    if args.capture is None:
+        parser.error('a capture is needed')
+    lines, overflows = demux(open(args.capture, 'rb').read(), args.port)
+    for port, text in lines:
+        print(text if args.port is not None else '%s: %s' % (label(port), text))
+    if overflows:
+        print('%d overflow packets, some output was lost' % overflows, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,449 @@
+#!/usr/bin/env python3
+"""Discrete-event model of OM over a network of n generals, for sizing.
+
+The RTX build delivers messages instantly between threads on one chip. This
+puts every general on a node of its own, joined to every other by a directed
+link with a latency distribution and a bandwidth, and charges each node's
+CPU per message sent and received, per wire byte and per EIG node resolved.
+It prints the predicted decision latency and the link and CPU utilization
+for each n and engine:
+
+    queue        one frame per path and receiver (frame.h), the default build
+    aggregate    one frame per receiver and round holding a batch (AGGREGATE)
+    mailbox      one row of slots per receiver and round, read only after the
+                 round barrier (MAILBOX)
+    interactive  every general commands at once, one vector batch per
+                 receiver and round across all instances (INTERACTIVE)
+    randomized   EST and AUX votes to everyone per coin round, then DECIDE,
+                 each step on a quorum (RANDOMIZED)
+    pbft         the commander's offer, then PREPARE, COMMIT and DECIDE to
+                 everyone, each step on a quorum (PBFT)
+    digest       OM over payload digests in batches, then one round in which
+                 every lieutenant fetches the payload (DIGEST)
+
+    python3 netsim.py [--n 10:100:10] [--traitors 1] [--engine queue,aggregate]
+                      [--latency exp:200] [--bandwidth 10e6] [--calibrate log.txt]
+    python3 netsim.py --selftest
+
+Latencies are in microseconds: const:US, uniform:LO:HI, exp:MEAN or
+lognormal:MEDIAN:SIGMA, one sample per message train. Everything a sender
+has for one receiver in a round is modelled as one train, sent back to back,
+which keeps the event count at n*n per round. Rounds are lockstep like the
+round barrier of the build, --dataflow starts each general's next round as
+soon as its own round is complete. --silent makes the traitors send nothing,
+so every round waits for --round-timeout. Messages other than OM's per path
+frames are FRAME_OVERHEAD plus the text general.c counts for them.
+
+The randomized and PBFT engines have no rounds: a general takes its next
+step as soon as it holds a quorum, counted here in messages from others
+(2t EST, n-t-1 AUX, 2t DECIDE; n-t-2 PREPARE, n-t-1 COMMIT). The coin of
+the randomized engine shows the loyal estimate with probability 1/2 per
+round. The commander stays loyal, so PBFT never changes view.
+
+--selftest checks the constants below against frame.h and general.c, and
+the schedules against the message counts of each engine.
+
+--calibrate reads the Chrome trace a TRACE build prints (trace.c) from a
+console log. The time a thread spent in a round, less its queue waits,
+divided by the messages it sent and received there gives the cost per
+message, and the resolve spans give the cost per EIG node.
+"""
+
+import argparse
+import heapq
+import json
+import math
+import os
+import random
+import re
+import statistics
+import sys
+
+# frame.h and general.c, --selftest compares them
+FRAME_OVERHEAD = 9
+BATCH_EXTRA = 3
+VECTOR_EXTRA = 3
+DIGEST_CHARS = 8
+DIGEST_EXTRA = 3
+VOTE_TEXT = 6
+MAILBOX_SLOT = 2
+
+ENGINES = ['queue', 'aggregate', 'mailbox', 'interactive', 'randomized', 'pbft', 'digest']
+# Engines that step on quorums, without rounds or barriers
+ASYNC = ('randomized', 'pbft')
+# Messages from others each step of them waits for, given n and t
+QUORUM = {
+    'est': lambda n, t: 2 * t,
+    'aux': lambda n, t: n - t - 1,
+    'decide': lambda n, t: 2 * t,
+    'prepare': lambda n, t: n - t - 2,
+    'commit': lambda n, t: n - t - 1,
+}
+
+
+def frameSize(pathLen):
+    return FRAME_OVERHEAD + pathLen
+
+
+def perm(n, k):
+    """Ordered choices of k out of n"""
+    result = 1
+    for i in range(k):
+        result *= n - i
+    return result
+
+
+def roundNodes(n, round):
+    """EIG nodes each lieutenant fills in a round, as in general.c"""
+    return perm(n - 2, round)
+
+
+def steps(engine, m, rng, payload):
+    """What each round of an instance is: 'om' for a round of EIG relays,
+    'payload' for the digest engine's fetch, or a vote kind"""
+    if engine == 'randomized':
+        rounds = 1
+        while rng.random() < 0.5:
+            rounds += 1
+        return ['command'] + ['est', 'aux'] * rounds + ['decide']
+    if engine == 'pbft':
+        return ['command', 'prepare', 'commit', 'decide']
+    return ['om'] * (m + 1) + (['payload'] if engine == 'digest' and payload else [])
+
+
+def trains(engine, n, sender, commander, round, step='om', payload=0):
+    """(receiver, messages, bytes each, paths) a sender puts on its links"""
+    others = [j for j in range(n) if j != sender]
+    if step in QUORUM:
+        if step == 'prepare' and sender == commander:
+            # The offer stands for the primary's PREPARE
+            return []
+        return [(j, 1, FRAME_OVERHEAD + VOTE_TEXT, 1) for j in others]
+    if step == 'payload':
+        if sender != commander:
+            return []
+        return [(j, 1, FRAME_OVERHEAD + payload, 1) for j in others]
+    if round == 0:
+        if engine == 'interactive':
+            return [(j, 1, frameSize(1), 1) for j in others]
+        if sender != commander:
+            return []
+        size = {'mailbox': FRAME_OVERHEAD + MAILBOX_SLOT,
+                'digest': FRAME_OVERHEAD + DIGEST_CHARS + DIGEST_EXTRA}.get(engine, frameSize(1))
+        return [(j, 1, size, 1) for j in others]
+    # Of the roundNodes(round-1) paths the sender relays, the ones without
+    # the receiver, each extended by the sender
+    paths = perm(n - 3, round - 1)
+    relays = roundNodes(n, round - 1)
+    if engine == 'interactive':
+        # Every instance but the sender's and the receiver's own
+        size = FRAME_OVERHEAD + n * relays + VECTOR_EXTRA
+        return [(j, 1, size, (n - 2) * paths) for j in others]
+    if sender == commander:
+        return []
+    receivers = [j for j in range(n) if j not in (sender, commander)]
+    if engine == 'aggregate':
+        return [(j, 1, FRAME_OVERHEAD + relays + BATCH_EXTRA, paths) for j in receivers]
+    if engine == 'mailbox':
+        return [(j, 1, FRAME_OVERHEAD + MAILBOX_SLOT * relays, paths) for j in receivers]
+    if engine == 'digest':
+        return [(j, 1, FRAME_OVERHEAD + DIGEST_CHARS * relays + DIGEST_EXTRA, paths) for j in receivers]
+    return [(j, paths, frameSize(round + 1), paths) for j in receivers]
+
+
+def parseLatency(spec):
+    kind, *values = spec.split(':')
+    values = [float(v) for v in values]
+    if kind == 'const':
+        return lambda rng: values[0]
+    if kind == 'uniform':
+        return lambda rng: rng.uniform(values[0], values[1])
+    if kind == 'exp':
+        return lambda rng: rng.expovariate(1 / values[0])
+    if kind == 'lognormal':
+        return lambda rng: rng.lognormvariate(math.log(values[0]), values[1])
+    raise argparse.ArgumentTypeError('unknown latency %s' % spec)
+
+
+class Simulation:
+    def __init__(self, n, traitors, engine, args, rng):
+        self.n, self.m, self.engine, self.args, self.rng = n, traitors, engine, args, rng
+        self.commander = 0
+        # The last ids are the traitors, the commander stays loyal
+        self.traitors = set(range(n - traitors, n))
+        self.latency = args.latency
+        self.steps = steps(engine, traitors, rng, args.payload)
+        rounds = len(self.steps)
+        self.events = []
+        self.seq = 0
+        self.cpuFree = [0.0] * n
+        self.cpuBusy = [0.0] * n
+        self.linkFree = {}
+        self.linkBusy = {}
+        self.received = [[0] * rounds for _ in range(n)]
+        self.expected = [[0] * rounds for _ in range(n)]
+        self.started = [[False] * rounds for _ in range(n)]
+        self.done = [[None] * rounds for _ in range(n)]
+        self.decided = [None] * n
+        self.messages = 0
+        self.bytes = 0
+        # Receivers wait for silent traitors too, until the deadline,
+        # unless a quorum is enough
+        for round, step in enumerate(self.steps):
+            for sender in range(n):
+                for receiver, _, _, paths in self.trains(sender, round):
+                    self.expected[receiver][round] += paths
+        self.needed = [[min(expected, QUORUM[step](n, traitors)) if step in QUORUM else expected
+                        for step, expected in zip(self.steps, row)] for row in self.expected]
+
+    def trains(self, sender, round):
+        return trains(self.engine, self.n, sender, self.commander, round, self.steps[round], self.args.payload)
+
+    def resolveNodes(self):
+        """EIG nodes a general resolves once the rounds are over"""
+        if self.engine in ASYNC:
+            return 0
+        nodes = sum(roundNodes(self.n, r) for r in range(self.m + 1))
+        return nodes * self.n if self.engine == 'interactive' else nodes
+
+    def at(self, time, action, *data):
+        heapq.heappush(self.events, (time, self.seq, action, data))
+        self.seq += 1
+
+    def cpu(self, node, now, cost):
+        start = max(now, self.cpuFree[node])
+        self.cpuFree[node] = start + cost
+        self.cpuBusy[node] += cost
+        return start + cost
+
+    def startRound(self, node, round, now):
+        if round >= len(self.steps):
+            self.at(self.cpu(node, now, self.args.resolve_cost * self.resolveNodes()), 'decide', node)
+            return
+        if self.started[node][round]:
+            return
+        self.started[node][round] = True
+        if not (self.args.silent and node in self.traitors):
+            for receiver, count, size, paths in self.trains(node, round):
+                cost = count * (self.args.send_cost + size * self.args.byte_cost)
+                self.at(self.cpu(node, now, cost), 'transmit', node, receiver, round, count, size, paths)
+        if self.received[node][round] >= self.needed[node][round]:
+            # The commander only keeps pace once its sends are out, and a
+            # quorum may have arrived before the round started
+            self.at(max(now, self.cpuFree[node]), 'complete', node, round)
+        elif self.args.silent and self.traitors:
+            self.at(now + self.args.round_timeout, 'complete', node, round)
+
+    def run(self):
+        for node in range(self.n):
+            self.at(0.0, 'start', node, 0)
+        while self.events:
+            now, _, action, data = heapq.heappop(self.events)
+            if action == 'start':
+                self.startRound(data[0], data[1], now)
+            elif action == 'transmit':
+                sender, receiver, round, count, size, paths = data
+                link = (sender, receiver)
+                start = max(now, self.linkFree.get(link, 0.0))
+                wire = count * size * 8 / self.args.bandwidth * 1e6
+                self.linkFree[link] = start + wire
+                self.linkBusy[link] = self.linkBusy.get(link, 0.0) + wire
+                self.messages += count
+                self.bytes += count * size
+                self.at(start + wire + self.latency(self.rng), 'arrive', receiver, round, count, size, paths)
+            elif action == 'arrive':
+                receiver, round, count, size, paths = data
+                cost = count * (self.args.recv_cost + size * self.args.byte_cost)
+                self.at(self.cpu(receiver, now, cost), 'store', receiver, round, paths)
+            elif action == 'store':
+                receiver, round, paths = data
+                self.received[receiver][round] += paths
+                if self.started[receiver][round] and self.received[receiver][round] >= self.needed[receiver][round]:
+                    self.at(now, 'complete', receiver, round)
+            elif action == 'complete':
+                self.complete(data[0], data[1], now)
+            elif action == 'decide':
+                self.decided[data[0]] = now
+        return self
+
+    def complete(self, node, round, now):
+        if self.done[node][round] is not None:
+            return
+        self.done[node][round] = now
+        if (self.args.dataflow and self.engine != 'mailbox') or self.engine in ASYNC:
+            self.at(now, 'start', node, round + 1)
+        elif all(done[round] is not None for done in self.done):
+            # Round barrier: everyone goes on once the last one is through
+            for other in range(self.n):
+                self.at(now, 'start', other, round + 1)
+
+    def report(self):
+        lieutenants = [self.decided[i] for i in range(self.n) if i not in self.traitors
+                       and (i != self.commander or self.engine == 'interactive')]
+        makespan = max(t for t in self.decided if t is not None)
+        links = [busy / makespan for busy in self.linkBusy.values()] or [0.0]
+        return {
+            'messages': self.messages,
+            'bytes': self.bytes,
+            'median': statistics.median(lieutenants),
+            'max': max(lieutenants),
+            'linkMean': sum(links) / (self.n * (self.n - 1)),
+            'linkMax': max(links),
+            'cpuMax': max(self.cpuBusy) / makespan,
+        }
+
+
+def calibrate(path):
+    """Cost per message and per EIG node from the trace JSON in a log"""
+    busy = events = resolve = nodes = 0.0
+    for doc in re.findall(r'\{"traceEvents":\[.*?\n\]\}', open(path).read(), re.S):
+        trace = json.loads(doc)['traceEvents']
+        spans, waits, flows, resolves = {}, {}, {}, []
+        open_ = {}
+        for event in trace:
+            tid, phase = event.get('tid'), event.get('ph')
+            if phase in ('s', 'f'):
+                flows.setdefault(tid, []).append(event['ts'])
+            elif phase in ('B', 'E') and 'general' in event.get('args', {}):
+                key = (event['name'], tid, event['args']['general'], event['args']['round'])
+                if phase == 'B':
+                    open_[key] = event['ts']
+                elif key in open_:
+                    span = (open_.pop(key), event['ts'])
+                    if key[0] == 'round':
+                        spans[key[1:]] = span
+                    elif key[0] == 'queue wait':
+                        waits.setdefault(key[1:], []).append(span)
+                    elif key[0] == 'resolve':
+                        resolves.append((key[2], key[3], span[1] - span[0]))
+        generals = {key[1] for key in spans}
+        n = len(generals)
+        for (tid, general, round), (begin, end) in spans.items():
+            handled = sum(1 for ts in flows.get(tid, []) if begin <= ts <= end)
+            if handled:
+                busy += end - begin - sum(e - b for b, e in waits.get((tid, general, round), []))
+                events += handled
+        for general, m, time in resolves:
+            resolve += time
+            nodes += sum(roundNodes(n, r) for r in range(m + 1))
+    if not events:
+        sys.exit('no trace with messages in %s' % path)
+    return busy / events, resolve / nodes if nodes else None
+
+
+def define(text, name):
+    """The value of #define name, its arguments and any u suffix dropped"""
+    found = re.search(r'#define %s(?:\([^)]*\))? +(.+)' % name, text)
+    return re.sub(r'(\d+)u\b', r'\1', found.group(1).strip()) if found else None
+
+
+def selftest(source):
+    """Checks the constants against frame.h and general.c, and the fault
+    free schedules against the message counts of each engine"""
+    frame = open(os.path.join(source, 'frame.h')).read()
+    general = open(os.path.join(source, 'general.c')).read()
+    wire = re.search(r'//   (SYNC .*)', frame).group(1).split(' | ')
+    checks = [
+        ('FRAME_OVERHEAD', define(frame, 'FRAME_OVERHEAD'), str(FRAME_OVERHEAD)),
+        ('wire format fields', len([field for field in wire if field != 'PATH...']), FRAME_OVERHEAD),
+        ('FRAME_SIZE', define(frame, 'FRAME_SIZE'), '(FRAME_OVERHEAD + (pathLen))'),
+        ('BATCH_TEXT', define(general, 'BATCH_TEXT'), '((relays)+%d)' % BATCH_EXTRA),
+        ('VECTOR_TEXT', define(general, 'VECTOR_TEXT'), '((n)*(relays)+%d)' % VECTOR_EXTRA),
+        ('DIGEST_CHARS', define(general, 'DIGEST_CHARS'), str(DIGEST_CHARS)),
+        ('DIGEST_TEXT', define(general, 'DIGEST_TEXT'), '(DIGEST_CHARS*(relays)+%d)' % DIGEST_EXTRA),
+        ('VOTE_TEXT', define(general, 'VOTE_TEXT'), str(VOTE_TEXT)),
+        ('MAILBOX_SLOT', 'uint16_t' in (define(general, 'MAILBOX_SLOT') or ''), MAILBOX_SLOT == 2),
+    ]
+
+    def messages(engine, n, m, rng=None, payload=16):
+        """Messages of each round of an instance without faults"""
+        kinds = steps(engine, m, rng or random.Random(0), payload)
+        return [sum(count for sender in range(n) for _, count, _, _ in trains(engine, n, sender, 0, r, kind, payload))
+                for r, kind in enumerate(kinds)]
+
+    for n in range(4, 9):
+        for m in range(1, (n - 1) // 3 + 1):
+            om = [(n - 1) * perm(n - 2, r) for r in range(m + 1)]
+            batches = [n - 1] + [(n - 1) * (n - 2)] * m
+            checks += [
+                ('queue n=%d m=%d' % (n, m), messages('queue', n, m), om),
+                ('aggregate n=%d m=%d' % (n, m), messages('aggregate', n, m), batches),
+                ('mailbox n=%d m=%d' % (n, m), messages('mailbox', n, m), batches),
+                ('digest n=%d m=%d' % (n, m), messages('digest', n, m), batches + [n - 1]),
+                ('interactive n=%d m=%d' % (n, m), messages('interactive', n, m), [n * (n - 1)] * (m + 1)),
+                ('pbft n=%d m=%d' % (n, m), messages('pbft', n, m), [n - 1, (n - 1) ** 2, n * (n - 1), n * (n - 1)]),
+            ]
+            vote = messages('randomized', n, m, random.Random(n))
+            checks.append(('randomized n=%d m=%d' % (n, m), vote, [n - 1] + [n * (n - 1)] * (len(vote) - 1)))
+            # Every loyal general decides, with the traitors silent too
+            for engine in ENGINES:
+                for silent in (False, True):
+                    args = argparse.Namespace(latency=parseLatency('exp:200'), bandwidth=10e6, send_cost=6.0,
+                                              recv_cost=6.0, byte_cost=0.05, resolve_cost=0.3, round_timeout=100e3,
+                                              dataflow=False, silent=silent, payload=64)
+                    sim = Simulation(n, m, engine, args, random.Random(n)).run()
+                    undecided = [i for i in range(n) if i not in sim.traitors and sim.decided[i] is None]
+                    checks.append(('%s n=%d m=%d%s decides' % (engine, n, m, ' silent' if silent else ''), undecided, []))
+    failed = 0
+    for name, got, want in checks:
+        if got != want:
+            print('%s: got %r, expected %r' % (name, got, want))
+            failed += 1
+    print('netsim: %d of %d checks failed' % (failed, len(checks)))
+    return failed == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--n', default='10:100:10', help='FIRST:LAST:STEP or one n')
+    parser.add_argument('--traitors', type=int, default=1, help='m, OM runs m+1 rounds')
+    parser.add_argument('--engine', default='queue,aggregate', help='any of ' + ','.join(ENGINES))
+    parser.add_argument('--latency', type=parseLatency, default='exp:200')
+    parser.add_argument('--bandwidth', type=float, default=10e6, help='bits per second of each link')
+    parser.add_argument('--send-cost', type=float, default=6.0, help='us of CPU per message sent')
+    parser.add_argument('--recv-cost', type=float, default=6.0, help='us of CPU per message received')
+    parser.add_argument('--byte-cost', type=float, default=0.05, help='us of CPU per wire byte')
+    parser.add_argument('--resolve-cost', type=float, default=0.3, help='us of CPU per EIG node')
+    parser.add_argument('--round-timeout', type=float, default=100e3, help='us a round waits for silent traitors')
+    parser.add_argument('--calibrate', help='console log of a TRACE build to take the costs from')
+    parser.add_argument('--dataflow', action='store_true', help='no round barrier')
+    parser.add_argument('--silent', action='store_true', help='traitors send nothing')
+    parser.add_argument('--runs', type=int, default=3, help='latency samples averaged per point')
+    parser.add_argument('--payload', type=int, default=256, help='bytes the digest engine fetches once agreed')
+    parser.add_argument('--seed', type=int, default=241)
+    parser.add_argument('--selftest', action='store_true', help='check the model against frame.h and general.c')
+    parser.add_argument('--source', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'),
+                        help='the tree with frame.h and general.c, for --selftest')
+    args = parser.parse_args()
+
+    if args.selftest:
+        sys.exit(0 if selftest(args.source) else 1)
+    for engine in args.engine.split(','):
+        if engine not in ENGINES:
+            parser.error('unknown engine %s' % engine)
+
+    if args.calibrate:
+        message, node = calibrate(args.calibrate)
+        args.send_cost = args.recv_cost = message
+        if node is not None:
+            args.resolve_cost = node
+        print('calibrated: %.2f us per message, %.3f us per EIG node' % (message, args.resolve_cost))
+
+    sweep = [int(v) for v in args.n.split(':')] + [0, 0]
+    first, last, step = sweep[0], sweep[1] or sweep[0], sweep[2] or 1
+    print('%-12s %4s %2s %10s %12s %10s %10s %7s %7s %7s' % (
+        'engine', 'n', 'm', 'messages', 'bytes', 'median ms', 'max ms', 'link %', 'max %', 'cpu %'))
+    for engine in args.engine.split(','):
+        for n in range(first, last + 1, step):
+            if n <= 3 * args.traitors:
+                continue
+            rng = random.Random(args.seed)
+            runs = [Simulation(n, args.traitors, engine, args, rng).run().report() for _ in range(args.runs)]
+            mean = {key: sum(run[key] for run in runs) / len(runs) for key in runs[0]}
+            print('%-12s %4d %2d %10d %12d %10.2f %10.2f %7.1f %7.1f %7.1f' % (
+                engine, n, args.traitors, mean['messages'], mean['bytes'], mean['median'] / 1e3, mean['max'] / 1e3,
+                100 * mean['linkMean'], 100 * mean['linkMax'], 100 * mean['cpuMax']))
+
+
+if __name__ == '__main__':
+    main()
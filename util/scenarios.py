@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Writes and reads the scenario corpus of the batch runner (scenario.h).
+
+The corpus is an 8 byte header, magic OMSC, version and record size, and
+then 8 byte records: n, loyal mask, reporter, commander, command, strategy,
+expected mask and flags. Bit i of a mask stands for general i.
+
+    python3 scenarios.py generate scenarios.bin [--max-n 7]
+    python3 scenarios.py add scenarios.bin --loyal 1110111 --commander 3 --command A [--strategy random] [--reporter 6]
+    python3 scenarios.py show scenarios.bin
+    python3 scenarios.py failures scenarios.bin failures.hex
+
+generate enumerates every instance OM can handle: n up to --max-n, up to 2
+traitors with n > 3m, every commander and command, and every strategy when
+there are traitors. add appends one record, say a replayed incident.
+failures decodes the scenario_result_t records the runner wrote, raw or as
+the Intel HEX file the debugger writes with
+    SAVE failures.hex corpusFailures, corpusFailures + sizeof(corpusFailures)
+"""
+
+import argparse
+import struct
+import sys
+
+from timeline import readHex
+
+MAGIC = b'OMSC'
+VERSION = 1
+HEADER = struct.Struct('<4sBBH')
+RECORD = struct.Struct('<BBBBcBBB')
+RESULT = struct.Struct('<IBBBB')
+
+MAX_ROUNDS = 3
+AGREE = 0x01
+STRATEGIES = ['parity', 'random', 'equivocate', 'target-reporter', 'silent', 'delay', 'flood']
+STATUS = ['pass', 'wrong', 'setup failed', 'bad record']
+
+
+def makeRecord(n, loyal, commander, command, strategy, reporter=None):
+    """The record of one instance, with what OM guarantees as expectation"""
+    lieutenants = [i for i in range(n) if i != commander]
+    if reporter is None:
+        loyalLieutenants = [i for i in lieutenants if loyal >> i & 1]
+        reporter = (loyalLieutenants or lieutenants)[-1]
+    expected, flags = 0, 0
+    if loyal >> commander & 1:
+        if command == 'A':
+            expected = sum(1 << i for i in lieutenants if loyal >> i & 1)
+    else:
+        flags |= AGREE
+    return RECORD.pack(n, loyal, reporter, commander, command.encode(), strategy, expected, flags)
+
+
+def generate(maxN):
+    for n in range(3, maxN + 1):
+        for loyal in range(1 << n):
+            traitors = n - bin(loyal).count('1')
+            if n <= 3 * traitors or traitors >= MAX_ROUNDS:
+                continue
+            for commander in range(n):
+                for command in 'AR':
+                    for strategy in range(len(STRATEGIES) if traitors else 1):
+                        yield makeRecord(n, loyal, commander, command, strategy)
+
+
+def readCorpus(path):
+    data = open(path, 'rb').read()
+    magic, version, size, _ = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or size != RECORD.size:
+        sys.exit('%s is not a version %d scenario corpus' % (path, VERSION))
+    return [RECORD.unpack_from(data, offset) for offset in range(HEADER.size, len(data) - size + 1, size)]
+
+
+def describe(record):
+    n, loyal, reporter, commander, command, strategy, expected, flags = record
+    mask = ''.join('1' if loyal >> i & 1 else '0' for i in range(n))
+    # Only the loyal lieutenants are checked, the rest show as -
+    checked = [loyal >> i & 1 and i != commander for i in range(n)]
+    want = 'agree' if flags & AGREE else ''.join(('A' if expected >> i & 1 else 'R') if checked[i] else '-' for i in range(n))
+    return 'n %d, loyal %s, commander %d, command %s, reporter %d, %s, expect %s' % (
+        n, mask, commander, command.decode(), reporter, STRATEGIES[strategy] if strategy < len(STRATEGIES) else '?', want)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='action', required=True)
+    p = commands.add_parser('generate')
+    p.add_argument('corpus')
+    p.add_argument('--max-n', type=int, default=7)
+    p = commands.add_parser('add')
+    p.add_argument('corpus')
+    p.add_argument('--loyal', required=True, help='one digit per general, 1 for loyal, general 0 first')
+    p.add_argument('--commander', type=int, required=True)
+    p.add_argument('--command', choices='AR', required=True)
+    p.add_argument('--strategy', choices=STRATEGIES, default='parity')
+    p.add_argument('--reporter', type=int)
+    p = commands.add_parser('show')
+    p.add_argument('corpus')
+    p = commands.add_parser('failures')
+    p.add_argument('corpus')
+    p.add_argument('dump')
+    args = parser.parse_args()
+
+    if args.action == 'generate':
+        records = list(generate(args.max_n))
+        with open(args.corpus, 'wb') as out:
+            out.write(HEADER.pack(MAGIC, VERSION, RECORD.size, 0))
+            out.writelines(records)
+        print('%d records' % len(records))
+    elif args.action == 'add':
+        readCorpus(args.corpus)
+        loyal = sum(1 << i for i, digit in enumerate(args.loyal) if digit == '1')
+        record = makeRecord(len(args.loyal), loyal, args.commander, args.command,
+                            STRATEGIES.index(args.strategy), args.reporter)
+        with open(args.corpus, 'ab') as out:
+            out.write(record)
+        print(describe(RECORD.unpack(record)))
+    elif args.action == 'show':
+        for index, record in enumerate(readCorpus(args.corpus)):
+            print('%d: %s' % (index, describe(record)))
+    else:
+        records = readCorpus(args.corpus)
+        data = readHex(args.dump) if args.dump.lower().endswith('.hex') else open(args.dump, 'rb').read()
+        for offset in range(0, len(data) - RESULT.size + 1, RESULT.size):
+            index, decided, wrong, status, _ = RESULT.unpack_from(data, offset)
+            if status == 0 or index >= len(records):
+                continue
+            n = records[index][0]
+            print('%d: %s, %s, decided %s, wrong %s' % (
+                index, describe(records[index]), STATUS[status] if status < len(STATUS) else '?',
+                ''.join('A' if decided >> i & 1 else 'R' for i in range(n)),
+                ','.join(str(i) for i in range(n) if wrong >> i & 1) or '-'))
+
+
+if __name__ == '__main__':
+    main()
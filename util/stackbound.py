@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Holds the stack of a general against the call graph armlink writes.
+
+general.c sizes every general's thread stack from an estimate, and never
+below OS_STACK_SIZE. This takes the deepest chain below the thread
+entries, general() and worker(), as the linker measured it with
+--callgraph, and adds the deepest function reached through a pointer (the
+traitor strategies, called through strategyTable), which armlink cannot
+follow, and the exception frame and kernel calls on top:
+
+    python util/stackbound.py Objects/final.htm [--stack 1024]
+
+It only prints, and warns when the stack is too small; a build never
+fails on it. The project has it as an After Build step, off by default.
+"""
+
+import argparse
+import re
+import sys
+
+ENTRIES = ['general', 'worker']
+INDIRECT = r'Strategy$'
+# EXCEPTION_FRAME and KERNEL_CALL_STACK of general.c
+OVERHEAD = 64 + 64
+
+
+def depths(html):
+    """Max Depth of every function in an armlink call graph, which is its
+    own frame for a function that calls nothing"""
+    result = {}
+    for chunk in html.split('<P><STRONG>')[1:]:
+        name = re.search(r'</a>([^<]+)</STRONG>', chunk)
+        depth = re.search(r'Max Depth = (\d+)', chunk) or re.search(r'Stack size (\d+) bytes', chunk)
+        if name and depth:
+            result[name.group(1)] = int(depth.group(1))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('callgraph', help='the .htm armlink wrote')
+    parser.add_argument('--stack', type=int, default=1024, help='bytes each general gets, what reportStacks() prints')
+    parser.add_argument('--indirect', default=INDIRECT, help='functions called through pointers, a regex')
+    args = parser.parse_args()
+
+    try:
+        graph = depths(open(args.callgraph, errors='replace').read())
+    except OSError as error:
+        print('stackbound: warning: %s' % error)
+        return
+    entries = [name for name in ENTRIES if name in graph]
+    if not entries:
+        print('stackbound: warning: %s has none of %s' % (args.callgraph, ', '.join(ENTRIES)))
+        return
+    deepest = max(graph[name] for name in entries)
+    indirect = max([depth for name, depth in graph.items() if re.search(args.indirect, name)] or [0])
+    bound = deepest + indirect + OVERHEAD
+    print('stackbound: %d bytes below %s, %d through pointers, %d for exceptions and the kernel: %d of %d' % (
+        deepest, ' and '.join(name + '()' for name in entries), indirect, OVERHEAD, bound, args.stack))
+    if bound > args.stack:
+        print('stackbound: warning: general stacks need %d bytes, raise the frames in general.c' % bound)
+    sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Per-general timeline of the OM events in an Event Recorder capture.
+
+The capture is the EventRecorderBuffer memory, either raw or as the Intel HEX
+file the debugger writes with
+    SAVE om.hex EventRecorderBuffer, EventRecorderBuffer + sizeof(EventRecorderBuffer)
+Each record is 16 bytes: timestamp, val1, val2 and info. The lower 16 bits of
+info are the event id, and bits 28 to 30 hold the most significant bits of
+timestamp, val1 and val2, whose own bit 31 is the recorder's toggle bit.
+
+    python3 timeline.py om.hex [--freq HZ]
+"""
+
+import argparse
+import struct
+import sys
+from collections import defaultdict
+
+EVR_OM_NO = 0x0A
+INSTANCE_START, ROUND_ENTER, ROUND_EXIT, RELAY_PUT, RELAY_GET, RESOLVE, DECISION = range(7)
+
+MSB_TS = 1 << 28
+MSB_V1 = 1 << 29
+MSB_V2 = 1 << 30
+
+
+def readHex(path):
+    memory = {}
+    base = 0
+    for line in open(path):
+        line = line.strip()
+        if not line.startswith(':'):
+            continue
+        raw = bytes.fromhex(line[1:])
+        count, address, kind = raw[0], (raw[1] << 8) | raw[2], raw[3]
+        data = raw[4:4 + count]
+        if kind == 0:
+            for i, byte in enumerate(data):
+                memory[base + address + i] = byte
+        elif kind == 2:
+            base = ((data[0] << 8) | data[1]) << 4
+        elif kind == 4:
+            base = ((data[0] << 8) | data[1]) << 16
+    if not memory:
+        return b''
+    start = min(memory)
+    return bytes(memory.get(a, 0) for a in range(start, max(memory) + 1))
+
+
+def readRecords(path):
+    data = readHex(path) if path.lower().endswith('.hex') else open(path, 'rb').read()
+    records = []
+    for offset in range(0, len(data) - 15, 16):
+        ts, val1, val2, info = struct.unpack_from('<4I', data, offset)
+        ts = (ts & 0x7FFFFFFF) | (0x80000000 if info & MSB_TS else 0)
+        val1 = (val1 & 0x7FFFFFFF) | (0x80000000 if info & MSB_V1 else 0)
+        val2 = (val2 & 0x7FFFFFFF) | (0x80000000 if info & MSB_V2 else 0)
+        if (info >> 8) & 0xFF == EVR_OM_NO:
+            records.append((ts, info & 0xFF, val1, val2))
+    records.sort()
+    return records
+
+
+def instances(records):
+    """Splits the records at every instance start"""
+    current = None
+    for record in records:
+        if record[1] == INSTANCE_START:
+            if current:
+                yield current
+            current = [record]
+        elif current is not None:
+            current.append(record)
+    if current:
+        yield current
+
+
+def report(records, freq):
+    def us(ticks):
+        return ticks * 1e6 / freq
+
+    start, _, val1, val2 = records[0]
+    commander, n, m = val1 & 0xFF, (val1 >> 8) & 0xFF, val2
+    print('instance at %.0f us: commander %d, n %d, m %d' % (us(start), commander, n, m))
+
+    enter = {}
+    rounds = defaultdict(dict)
+    lastFrom = {}
+    decisions = {}
+    for ts, msg, val1, val2 in records[1:]:
+        if msg == ROUND_ENTER:
+            enter[(val1, val2)] = ts
+        elif msg == ROUND_EXIT:
+            general, round = val1, val2 & 0xFF
+            rounds[general][round] = (enter.get((general, round), ts), ts, val2 >> 8, lastFrom.get((general, round)))
+        elif msg == RELAY_GET:
+            general, round = val1 & 0xFF, (val1 >> 16) & 0xFF
+            lastFrom[(general, round)] = (ts, val2 >> (4 * round) & 0xF if val2 else commander)
+        elif msg == DECISION:
+            decisions[val1] = (ts, chr(val2))
+
+    # One row per general, each round as [entered..left] received/expected
+    for general in sorted(set(rounds) | set(decisions)):
+        cells = []
+        for round in range(m + 1):
+            if round not in rounds[general]:
+                cells.append('r%d -' % round)
+                continue
+            entered, left, received, _ = rounds[general][round]
+            expected = 1
+            for k in range(round):
+                expected *= n - 2 - k
+            cells.append('r%d %.0f..%.0f %d/%d' % (round, us(entered - start), us(left - start), received, expected))
+        decided = decisions.get(general)
+        if decided:
+            cells.append('%c at %.0f' % (decided[1], us(decided[0] - start)))
+        print('  id %d: %s' % (general, ', '.join(cells)))
+
+    # The general that left each round last, and whose message it waited for.
+    # A chain of the same senders across rounds is a convoy
+    for round in range(m + 1):
+        left = [(r[round][1], g, r[round][3]) for g, r in rounds.items() if round in r]
+        if not left:
+            continue
+        left.sort()
+        median = left[len(left) // 2][0]
+        last, general, waited = left[-1]
+        line = '  round %d: id %d left last, %.0f us after the median' % (round, general, us(last - median))
+        if waited:
+            line += ', its last message came from id %d' % waited[1]
+        print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture')
+    parser.add_argument('--freq', type=float, default=100e6, help='Event Recorder timestamp frequency, the core clock by default')
+    args = parser.parse_args()
+    records = readRecords(args.capture)
+    if not records:
+        sys.exit('no OM events in %s' % args.capture)
+    for instance in instances(records):
+        report(instance, args.freq)
+
+
+if __name__ == '__main__':
+    main()
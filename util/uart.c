@@ -198,6 +198,56 @@ uint32_t getFrequency(uint32_t clk_slct){
 	return pclk;
 }
 
+/*****************************************************************************
+** Function name:		UARTBaudDivider
+**
+** Descriptions:		Search the divisor latch (DLM:DLL) and the fractional
+**						divider (FDR) for the rate closest to baudrate.
+**						UARTn_baudrate = PCLK / (16 * DL * (1 + DIVADDVAL / MULVAL))
+**						with 1 <= MULVAL <= 15, 0 <= DIVADDVAL < MULVAL, and
+**						DL >= 3 whenever DIVADDVAL is not zero (UM10360 14.4.12)
+**
+** parameters:			pclk, baudrate, and where to store DL and FDR
+** Returned value:		the baud rate the divider really gives, 0 if none
+**						is within 1/32 (about 3%) of baudrate
+** 
+*****************************************************************************/
+uint32_t UARTBaudDivider( uint32_t pclk, uint32_t baudrate, uint32_t *dl, uint32_t *fdr )
+{
+	uint32_t mulVal, divAddVal, latch, scale, bestScale = 0;
+	uint64_t num, den, error, bestError = 0;
+
+	for ( mulVal = 1; mulVal <= 15; mulVal++ )
+	{
+		for ( divAddVal = 0; divAddVal < mulVal; divAddVal++ )
+		{
+			/* DL rounded to nearest for this fraction */
+			num = (uint64_t)pclk * mulVal;
+			den = 16ULL * baudrate * ( mulVal + divAddVal );
+			latch = (uint32_t)(( num + den / 2 ) / den);
+			if ( latch < ( divAddVal ? 3 : 1 ) || latch > 0xFFFF )
+				continue;
+
+			/* |rate - baudrate| = error / (16 * scale) */
+			scale = latch * ( mulVal + divAddVal );
+			den = 16ULL * scale * baudrate;
+			error = num > den ? num - den : den - num;
+
+			/* Compare the rate errors without dividing, the first fit wins a tie */
+			if ( bestScale == 0 || error * bestScale < bestError * scale )
+			{
+				bestError = error;
+				bestScale = scale;
+				*dl = latch;
+				*fdr = ( mulVal << 4 ) | divAddVal;
+			}
+		}
+	}
+	if ( bestScale == 0 || bestError * 32 > 16ULL * bestScale * baudrate )
+		return 0;
+	return (uint32_t)(( (uint64_t)pclk * ( *fdr >> 4 ) ) / ( 16ULL * bestScale ));
+}
+
 /*****************************************************************************
 ** Function name:		UARTInit
 **
@@ -212,7 +262,7 @@ uint32_t getFrequency(uint32_t clk_slct){
 *****************************************************************************/
 uint32_t UARTInit( uint32_t PortNum, uint32_t baudrate )
 {
-	uint32_t Fdiv;
+	uint32_t Fdiv, Fdr;
 	uint32_t  pclk;
 
 	if ( PortNum == 0 )
@@ -222,12 +272,14 @@ uint32_t UARTInit( uint32_t PortNum, uint32_t baudrate )
 
 		/* Bit 6~7 is for UART0 */
 		pclk = getFrequency(6);
+		if ( UARTBaudDivider( pclk, baudrate, &Fdiv, &Fdr ) == 0 )
+			return (FALSE);	/* baudrate is out of reach of this PCLK */
 
 		LPC_UART0->LCR = 0x83;		/* 8 bits, no Parity, 1 Stop bit, The access to Divisor latches is enabled. */
 
-		Fdiv = ( pclk / 16 ) / baudrate ;	/*baud rate */
 		LPC_UART0->DLM = Fdiv / 256;					
 		LPC_UART0->DLL = Fdiv % 256;
+		LPC_UART0->FDR = Fdr;		/* MULVAL in bits 4~7, DIVADDVAL in bits 0~3 */
 
 		LPC_UART0->LCR = 0x03;		/* DLAB = 0 */
 		LPC_UART0->FCR = 0x07;		/* Enable and reset TX and RX FIFO. */
@@ -250,12 +302,14 @@ uint32_t UARTInit( uint32_t PortNum, uint32_t baudrate )
 	all the peripherals is 1/4 of the SystemFrequency. */
 	/* Bit 8,9 are for UART1 */
 		pclk = getFrequency(8);
+		if ( UARTBaudDivider( pclk, baudrate, &Fdiv, &Fdr ) == 0 )
+			return (FALSE);	/* baudrate is out of reach of this PCLK */
 
 		LPC_UART1->LCR = 0x83;		/* 8 bits, no Parity, 1 Stop bit */
 
-		Fdiv = ( pclk / 16 ) / baudrate ;	/*baud rate */
 		LPC_UART1->DLM = Fdiv / 256;					
 		LPC_UART1->DLL = Fdiv % 256;
+		LPC_UART1->FDR = Fdr;		/* MULVAL in bits 4~7, DIVADDVAL in bits 0~3 */
 
 		LPC_UART1->LCR = 0x03;		/* DLAB = 0 */
 		LPC_UART1->FCR = 0x07;		/* Enable and reset TX and RX FIFO. */
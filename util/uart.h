@@ -56,6 +56,7 @@ void UART0_IRQHandler( void );
 void UART1_IRQHandler( void );
 
 uint32_t UARTInit( uint32_t portNum, uint32_t Baudrate );
+uint32_t UARTBaudDivider( uint32_t pclk, uint32_t baudrate, uint32_t *dl, uint32_t *fdr );
 
 void     UARTSend(    uint32_t portNum, uint8_t *BufferPtr, uint32_t Length );
 uint32_t UARTRecieve( uint32_t portNum, uint8_t *BufferPtr, uint32_t Length );